@@ -0,0 +1,4 @@
+mkdir bin
+
+REM Requires a C++17 compiler, e.g. MinGW-w64 or clang
+CALL g++ -O3 -std=gnu++17 -o "bin/sha1_bench" sha1_bench.cpp
@@ -0,0 +1,94 @@
+/*
+Benchmark of the native sha-1 kernels, with hardware performance counters (see perf_counters.h)
+
+Usage: sha1_bench [<total MB>]
+Each backend which is supported by the CPU hashes the same amount of data (1024 MB by default) from buffers of
+different sizes, so the results show the kernel when its data is in L1, L2, and when it comes from main memory
+The buffers are hashed in pieces of 1 MB (or the buffer size, if it's smaller), like the pieces of a torrent
+
+Build with build.bat in this folder
+*/
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "../perf_counters.h"
+#include "../sha1_native.h"
+
+static constexpr size_t pieceSize = 1024 * 1024;
+
+struct BufferCase
+{
+    const char* name;
+    size_t size;
+};
+
+static const BufferCase bufferCases[] = {
+    {"16 KB (L1)", 16 * 1024},
+    {"256 KB (L2)", 256 * 1024},
+    {"256 MB (memory)", 256 * 1024 * 1024},
+};
+
+// Keeps the hashing from being optimized away
+static volatile uint8_t hashSink;
+
+static void benchmarkBackend(Profiler& profiler, const char* backend, uint64_t totalSize)
+{
+    uint8_t hash[20];
+
+    for (const BufferCase& bufferCase : bufferCases)
+    {
+        std::vector<uint8_t> buffer(bufferCase.size);
+        for (size_t i = 0; i < buffer.size(); ++i)
+        {
+            buffer[i] = (uint8_t)(i * 2654435761u >> 24);
+        }
+
+        size_t currentPieceSize = std::min(pieceSize, buffer.size());
+        uint64_t pieceCount = std::max<uint64_t>(totalSize / currentPieceSize, 1);
+
+        std::string stageName = std::string(backend) + " " + bufferCase.name;
+        Profiler::Stage stage(profiler, stageName.c_str());
+
+        size_t offset = 0;
+        for (uint64_t i = 0; i < pieceCount; ++i)
+        {
+            hashMessage(buffer.data() + offset, currentPieceSize, hash);
+            hashSink = hashSink ^ hash[0];
+
+            offset += currentPieceSize;
+            if (offset == buffer.size())
+            {
+                offset = 0;
+            }
+        }
+
+        stage.end(pieceCount * currentPieceSize);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    uint64_t totalSize = (argc > 1 ? strtoull(argv[1], nullptr, 10) : 1024) * 1024 * 1024;
+    if (totalSize == 0)
+    {
+        fprintf(stderr, "Usage: sha1_bench [<total MB>]\n");
+        return 1;
+    }
+
+    Profiler profiler(true);
+
+    benchmarkBackend(profiler, "portable", totalSize);
+
+    selectBlocksFunction();
+    if (blocksFunction != sha1BlocksPortable)
+    {
+        benchmarkBackend(profiler, backendName, totalSize);
+    }
+
+    profiler.print(stdout);
+    return 0;
+}
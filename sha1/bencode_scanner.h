@@ -0,0 +1,194 @@
+/*
+In-place bencode scanner, shared by the native tools which read .torrent files
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// Scans bencode data in place, every function returns false if the data is invalid
+class BencodeScanner
+{
+public:
+    BencodeScanner(const uint8_t* data, size_t length) : data(data), length(length)
+    {
+    }
+
+    // Skips the value at the position, and sets the position to the end of it
+    bool skipValue(size_t& position, int depth = 0) const
+    {
+        if (position >= length || depth > maxDepth)
+        {
+            return false;
+        }
+
+        switch (data[position])
+        {
+            case 'i':
+            {
+                int64_t unused;
+                return readInteger(position, unused);
+            }
+            case 'l':
+            case 'd':
+            {
+                bool isDictionary = data[position] == 'd';
+                ++position;
+
+                while (position < length && data[position] != 'e')
+                {
+                    std::string_view key;
+                    if (isDictionary && !readString(position, key))
+                    {
+                        return false;
+                    }
+
+                    if (!skipValue(position, depth + 1))
+                    {
+                        return false;
+                    }
+                }
+
+                if (position >= length)
+                {
+                    return false;
+                }
+
+                ++position;
+                return true;
+            }
+            default:
+            {
+                std::string_view unused;
+                return readString(position, unused);
+            }
+        }
+    }
+
+    bool readInteger(size_t& position, int64_t& value) const
+    {
+        if (position >= length || data[position] != 'i')
+        {
+            return false;
+        }
+
+        ++position;
+
+        bool isNegative = position < length && data[position] == '-';
+        if (isNegative)
+        {
+            ++position;
+        }
+
+        size_t digitsStart = position;
+        uint64_t absoluteValue = 0;
+        while (position < length && data[position] >= '0' && data[position] <= '9')
+        {
+            absoluteValue = absoluteValue * 10 + (data[position] - '0');
+            ++position;
+        }
+
+        if (position == digitsStart || position >= length || data[position] != 'e')
+        {
+            return false;
+        }
+
+        ++position;
+        value = isNegative ? -(int64_t)absoluteValue : (int64_t)absoluteValue;
+        return true;
+    }
+
+    bool readString(size_t& position, std::string_view& value) const
+    {
+        size_t stringLength = 0;
+        size_t digitsStart = position;
+        while (position < length && data[position] >= '0' && data[position] <= '9')
+        {
+            stringLength = stringLength * 10 + (data[position] - '0');
+            ++position;
+
+            if (stringLength > length)
+            {
+                return false;
+            }
+        }
+
+        if (position == digitsStart || position >= length || data[position] != ':')
+        {
+            return false;
+        }
+
+        ++position;
+        if (stringLength > length - position)
+        {
+            return false;
+        }
+
+        value = std::string_view((const char*)data + position, stringLength);
+        position += stringLength;
+        return true;
+    }
+
+    // Calls the callback with the position of the value of each key, the callback must skip the value
+    template <typename Callback>
+    bool forEachEntry(size_t& position, Callback callback) const
+    {
+        if (position >= length || data[position] != 'd')
+        {
+            return false;
+        }
+
+        ++position;
+        while (position < length && data[position] != 'e')
+        {
+            std::string_view key;
+            if (!readString(position, key) || !callback(key, position))
+            {
+                return false;
+            }
+        }
+
+        if (position >= length)
+        {
+            return false;
+        }
+
+        ++position;
+        return true;
+    }
+
+    // Same as forEachEntry, for the items of a list
+    template <typename Callback>
+    bool forEachItem(size_t& position, Callback callback) const
+    {
+        if (position >= length || data[position] != 'l')
+        {
+            return false;
+        }
+
+        ++position;
+        while (position < length && data[position] != 'e')
+        {
+            if (!callback(position))
+            {
+                return false;
+            }
+        }
+
+        if (position >= length)
+        {
+            return false;
+        }
+
+        ++position;
+        return true;
+    }
+
+private:
+    static constexpr int maxDepth = 64;
+
+    const uint8_t* data;
+    size_t length;
+};
@@ -1,7 +1,8 @@
-mkdir bin
+REM The modules are written directly into src/wasm, where the app loads them from
+REM Rebuild after every change of sha1.cpp, older builds don't have the newer exports (e.g. sha1SegmentsFused)
 
 REM Build without SIMD
-CALL em++ --no-entry -sSTANDALONE_WASM -O3 -flto -sENVIRONMENT=web -sMALLOC=none -fno-vectorize -fno-slp-vectorize -o "bin/Sha1.js" sha1.cpp
+CALL em++ --no-entry -sSTANDALONE_WASM -O3 -flto -sENVIRONMENT=web -sMALLOC=none -fno-vectorize -fno-slp-vectorize -o "../src/wasm/Sha1.wasm" sha1.cpp
 
 REM Build with SIMD
-CALL em++ --no-entry -sSTANDALONE_WASM -O3 -flto -sENVIRONMENT=web -sMALLOC=none -msimd128 -o "bin/Sha1Simd.js" sha1.cpp
+CALL em++ --no-entry -sSTANDALONE_WASM -O3 -flto -sENVIRONMENT=web -sMALLOC=none -msimd128 -o "../src/wasm/Sha1Simd.wasm" sha1.cpp
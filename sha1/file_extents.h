@@ -0,0 +1,114 @@
+/*
+Physical extents of files, for finding files which share all of their data on disk
+
+On file systems with copy-on-write (e.g. btrfs or XFS), copies made with reflinks, files in snapshots and hard links
+point to the same extents on disk. Files with the same size and the same physical extents at the same positions have
+the same contents, so their data only has to be read once
+On Linux, the extents are queried with the FIEMAP ioctl. Extents whose physical position doesn't identify their data
+(e.g. compressed, inline or not yet allocated extents) are not used, and those files are handled as unique files, like
+every file on other file systems and operating systems
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <linux/fiemap.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#endif
+
+struct FileExtent
+{
+    uint64_t logical;
+    uint64_t physical;
+    uint64_t length;
+
+    bool operator<(const FileExtent& other) const
+    {
+        if (logical != other.logical)
+        {
+            return logical < other.logical;
+        }
+
+        if (physical != other.physical)
+        {
+            return physical < other.physical;
+        }
+
+        return length < other.length;
+    }
+};
+
+// Returns false if the extents of the file are not known, or they can't be used for comparing the data of files
+static bool getFileExtents(const std::string& path, std::vector<FileExtent>& extents)
+{
+    extents.clear();
+
+#ifdef __linux__
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1)
+    {
+        return false;
+    }
+
+    static constexpr uint32_t batchExtentCount = 256;
+    static constexpr uint32_t unusableFlags = FIEMAP_EXTENT_UNKNOWN | FIEMAP_EXTENT_DELALLOC | FIEMAP_EXTENT_ENCODED |
+                                              FIEMAP_EXTENT_DATA_ENCRYPTED | FIEMAP_EXTENT_NOT_ALIGNED |
+                                              FIEMAP_EXTENT_DATA_INLINE | FIEMAP_EXTENT_DATA_TAIL;
+
+    std::vector<uint8_t> buffer(sizeof(fiemap) + batchExtentCount * sizeof(fiemap_extent));
+    fiemap* map = (fiemap*)buffer.data();
+
+    bool isOk = true;
+    bool isLastExtent = false;
+    uint64_t start = 0;
+
+    while (isOk && !isLastExtent)
+    {
+        memset(buffer.data(), 0, buffer.size());
+        map->fm_start = start;
+        map->fm_length = FIEMAP_MAX_OFFSET - start;
+        map->fm_flags = FIEMAP_FLAG_SYNC; // Data which is not written yet doesn't have its final position
+        map->fm_extent_count = batchExtentCount;
+
+        if (ioctl(fd, FS_IOC_FIEMAP, map) != 0)
+        {
+            isOk = false;
+            break;
+        }
+
+        if (map->fm_mapped_extents == 0)
+        {
+            break;
+        }
+
+        for (uint32_t i = 0; i < map->fm_mapped_extents; ++i)
+        {
+            const fiemap_extent& extent = map->fm_extents[i];
+            if ((extent.fe_flags & unusableFlags) != 0)
+            {
+                isOk = false;
+            }
+
+            isLastExtent = isLastExtent || (extent.fe_flags & FIEMAP_EXTENT_LAST) != 0;
+            extents.push_back({extent.fe_logical, extent.fe_physical, extent.fe_length});
+            start = extent.fe_logical + extent.fe_length;
+        }
+    }
+
+    close(fd);
+
+    // Files without any extents (empty, or only holes) are not compared, they don't have any data on the disk
+    return isOk && !extents.empty();
+#else
+    (void)path;
+    return false;
+#endif
+}
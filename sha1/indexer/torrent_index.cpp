@@ -0,0 +1,504 @@
+/*
+Bulk indexer for .torrent files: calculates the info hash, and extracts the name, piece length and file list of each
+torrent, using multiple threads
+
+Usage: torrent_index [--profile] <output file> [<list file>]
+The list file contains the paths of the .torrent files, one per line, the paths are read from stdin if it's omitted
+With --profile, the time and hardware counters of each stage are printed to stderr (see perf_counters.h)
+
+The bencode data is scanned in place, without building an object model: the exact byte range of the info dictionary
+is located and hashed directly, so the info hash is correct even if the dictionary is not canonically encoded
+
+The output is a columnar file, all numbers are little-endian:
+    char magic[4] = "TIDX"
+    u32 version = 1
+    u64 torrentCount
+    u64 fileCount
+    u8  status[torrentCount]                         (see TorrentStatus)
+    u8  infoHash[torrentCount][20]
+    u64 pieceLength[torrentCount]
+    u64 totalLength[torrentCount]
+    u64 fileStart[torrentCount + 1]                  (files of torrent i: fileStart[i] .. fileStart[i + 1])
+    string column torrentPath[torrentCount]
+    string column name[torrentCount]
+    u64 fileLength[fileCount]
+    string column filePath[fileCount]                (path elements joined with '/')
+A string column of n strings is: u64 offsets[n + 1], followed by offsets[n] bytes of utf-8 data
+Single-file torrents have one file, with an empty path
+Torrents with an error status have no files, an empty name, and zero lengths
+
+Build with build.bat in this folder
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "../bencode_scanner.h"
+#include "../perf_counters.h"
+#include "../sha1_native.h"
+
+enum class TorrentStatus : uint8_t
+{
+    Ok = 0,
+    ReadError = 1,
+    InvalidBencode = 2,
+    MissingInfo = 3,
+};
+
+struct FileEntry
+{
+    uint64_t length;
+    std::string path;
+};
+
+struct TorrentEntry
+{
+    TorrentStatus status = TorrentStatus::Ok;
+    uint8_t infoHash[20] = {};
+    uint64_t pieceLength = 0;
+    uint64_t totalLength = 0;
+    std::string name;
+    std::vector<FileEntry> files;
+};
+
+static bool readFilePath(const BencodeScanner& scanner, size_t& position, std::string& path)
+{
+    return scanner.forEachItem(position, [&](size_t& itemPosition) {
+        std::string_view element;
+        if (!scanner.readString(itemPosition, element))
+        {
+            return false;
+        }
+
+        if (!path.empty())
+        {
+            path += '/';
+        }
+
+        path += element;
+        return true;
+    });
+}
+
+static bool readFileEntry(const BencodeScanner& scanner, size_t& position, FileEntry& file)
+{
+    return scanner.forEachEntry(position, [&](std::string_view key, size_t& valuePosition) {
+        if (key == "length")
+        {
+            int64_t length;
+            if (!scanner.readInteger(valuePosition, length) || length < 0)
+            {
+                return false;
+            }
+
+            file.length = (uint64_t)length;
+            return true;
+        }
+
+        if (key == "path")
+        {
+            return readFilePath(scanner, valuePosition, file.path);
+        }
+
+        return scanner.skipValue(valuePosition);
+    });
+}
+
+static bool readInfo(const BencodeScanner& scanner, size_t& position, TorrentEntry& torrent)
+{
+    bool isSingleFile = false;
+    uint64_t singleFileLength = 0;
+
+    bool isValid = scanner.forEachEntry(position, [&](std::string_view key, size_t& valuePosition) {
+        if (key == "name")
+        {
+            std::string_view name;
+            if (!scanner.readString(valuePosition, name))
+            {
+                return false;
+            }
+
+            torrent.name = name;
+            return true;
+        }
+
+        if (key == "piece length" || key == "length")
+        {
+            // Negative lengths are reported as invalid, instead of wrapping around to huge unsigned values
+            int64_t value;
+            if (!scanner.readInteger(valuePosition, value) || value < 0)
+            {
+                return false;
+            }
+
+            if (key == "length")
+            {
+                isSingleFile = true;
+                singleFileLength = (uint64_t)value;
+            }
+            else
+            {
+                torrent.pieceLength = (uint64_t)value;
+            }
+
+            return true;
+        }
+
+        if (key == "files")
+        {
+            return scanner.forEachItem(valuePosition, [&](size_t& itemPosition) {
+                torrent.files.emplace_back();
+                return readFileEntry(scanner, itemPosition, torrent.files.back());
+            });
+        }
+
+        return scanner.skipValue(valuePosition);
+    });
+
+    if (isSingleFile)
+    {
+        torrent.files.clear();
+        torrent.files.push_back({singleFileLength, ""});
+    }
+
+    for (const FileEntry& file : torrent.files)
+    {
+        torrent.totalLength += file.length;
+    }
+
+    return isValid;
+}
+
+// The fields which were read before the error are not written, the torrent is written without a name and files
+static void setFailed(TorrentEntry& torrent, TorrentStatus status)
+{
+    torrent.status = status;
+    torrent.name.clear();
+    torrent.pieceLength = 0;
+    torrent.totalLength = 0;
+    torrent.files.clear();
+}
+
+static void indexTorrent(const uint8_t* data, size_t length, TorrentEntry& torrent)
+{
+    BencodeScanner scanner(data, length);
+
+    size_t infoStart = 0;
+    size_t infoEnd = 0;
+
+    size_t position = 0;
+    bool isValid = scanner.forEachEntry(position, [&](std::string_view key, size_t& valuePosition) {
+        if (key != "info")
+        {
+            return scanner.skipValue(valuePosition);
+        }
+
+        infoStart = valuePosition;
+        if (!readInfo(scanner, valuePosition, torrent))
+        {
+            return false;
+        }
+
+        infoEnd = valuePosition;
+        return true;
+    });
+
+    if (!isValid)
+    {
+        setFailed(torrent, TorrentStatus::InvalidBencode);
+        return;
+    }
+
+    if (infoEnd == 0)
+    {
+        setFailed(torrent, TorrentStatus::MissingInfo);
+        return;
+    }
+
+    hashMessage(data + infoStart, infoEnd - infoStart, torrent.infoHash);
+}
+
+static bool readWholeFile(const std::string& path, std::vector<uint8_t>& buffer)
+{
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == nullptr)
+    {
+        return false;
+    }
+
+    // The buffer is reused for the torrents of the same thread, and the data is parsed from it in place
+    bool isOk = fseek(file, 0, SEEK_END) == 0;
+    long length = isOk ? ftell(file) : -1;
+    isOk = length >= 0 && fseek(file, 0, SEEK_SET) == 0;
+
+    if (isOk)
+    {
+        buffer.resize((size_t)length);
+        isOk = fread(buffer.data(), 1, buffer.size(), file) == buffer.size();
+    }
+
+    fclose(file);
+    return isOk;
+}
+
+class OutputWriter
+{
+public:
+    explicit OutputWriter(FILE* file) : file(file)
+    {
+    }
+
+    void write(const void* data, size_t length)
+    {
+        isOk = isOk && fwrite(data, 1, length, file) == length;
+    }
+
+    void writeU32(uint32_t value)
+    {
+        uint8_t bytes[4];
+        for (int i = 0; i < 4; ++i)
+        {
+            bytes[i] = (uint8_t)(value >> (i * 8));
+        }
+
+        write(bytes, 4);
+    }
+
+    void writeU64(uint64_t value)
+    {
+        uint8_t bytes[8];
+        for (int i = 0; i < 8; ++i)
+        {
+            bytes[i] = (uint8_t)(value >> (i * 8));
+        }
+
+        write(bytes, 8);
+    }
+
+    template <typename GetString>
+    void writeStringColumn(size_t count, GetString getString)
+    {
+        uint64_t offset = 0;
+        writeU64(offset);
+        for (size_t i = 0; i < count; ++i)
+        {
+            offset += getString(i).size();
+            writeU64(offset);
+        }
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            const std::string& value = getString(i);
+            write(value.data(), value.size());
+        }
+    }
+
+    bool isOk = true;
+
+private:
+    FILE* file;
+};
+
+static bool writeIndex(const char* outputPath, const std::vector<std::string>& paths,
+                       const std::vector<TorrentEntry>& torrents)
+{
+    FILE* file = fopen(outputPath, "wb");
+    if (file == nullptr)
+    {
+        return false;
+    }
+
+    // Flattened file list, with the index of the first file of each torrent
+    std::vector<const FileEntry*> files;
+    std::vector<uint64_t> fileStarts;
+    for (const TorrentEntry& torrent : torrents)
+    {
+        fileStarts.push_back(files.size());
+        for (const FileEntry& fileEntry : torrent.files)
+        {
+            files.push_back(&fileEntry);
+        }
+    }
+
+    fileStarts.push_back(files.size());
+
+    OutputWriter writer(file);
+    writer.write("TIDX", 4);
+    writer.writeU32(1);
+    writer.writeU64(torrents.size());
+    writer.writeU64(files.size());
+
+    for (const TorrentEntry& torrent : torrents)
+    {
+        writer.write(&torrent.status, 1);
+    }
+
+    for (const TorrentEntry& torrent : torrents)
+    {
+        writer.write(torrent.infoHash, 20);
+    }
+
+    for (const TorrentEntry& torrent : torrents)
+    {
+        writer.writeU64(torrent.pieceLength);
+    }
+
+    for (const TorrentEntry& torrent : torrents)
+    {
+        writer.writeU64(torrent.totalLength);
+    }
+
+    for (uint64_t fileStart : fileStarts)
+    {
+        writer.writeU64(fileStart);
+    }
+
+    writer.writeStringColumn(paths.size(), [&](size_t i) -> const std::string& { return paths[i]; });
+    writer.writeStringColumn(torrents.size(), [&](size_t i) -> const std::string& { return torrents[i].name; });
+
+    for (const FileEntry* fileEntry : files)
+    {
+        writer.writeU64(fileEntry->length);
+    }
+
+    writer.writeStringColumn(files.size(), [&](size_t i) -> const std::string& { return files[i]->path; });
+
+    return fclose(file) == 0 && writer.isOk;
+}
+
+int main(int argc, char** argv)
+{
+    bool isProfiling = argc > 1 && std::string_view(argv[1]) == "--profile";
+    int argumentStart = isProfiling ? 2 : 1;
+    int argumentCount = argc - argumentStart;
+
+    if (argumentCount < 1 || argumentCount > 2)
+    {
+        std::cerr << "Usage: torrent_index [--profile] <output file> [<list file>]" << std::endl;
+        return 1;
+    }
+
+    const char* outputPath = argv[argumentStart];
+    const char* listPath = argumentCount == 2 ? argv[argumentStart + 1] : nullptr;
+
+    Profiler profiler(isProfiling);
+
+    Profiler::Stage listStage(profiler, "read list");
+    std::vector<std::string> paths;
+    {
+        FILE* listFile = listPath != nullptr ? fopen(listPath, "rb") : stdin;
+        if (listFile == nullptr)
+        {
+            std::cerr << "Cannot open the list file: " << listPath << std::endl;
+            return 1;
+        }
+
+        std::string line;
+        int character;
+        while ((character = fgetc(listFile)) != EOF)
+        {
+            if (character == '\n')
+            {
+                if (!line.empty() && line.back() == '\r')
+                {
+                    line.pop_back();
+                }
+
+                if (!line.empty())
+                {
+                    paths.push_back(std::move(line));
+                }
+
+                line.clear();
+            }
+            else
+            {
+                line += (char)character;
+            }
+        }
+
+        if (!line.empty())
+        {
+            paths.push_back(std::move(line));
+        }
+
+        if (listFile != stdin)
+        {
+            fclose(listFile);
+        }
+    }
+
+    listStage.end(0);
+
+    selectBlocksFunction();
+
+    auto startTime = std::chrono::steady_clock::now();
+
+    Profiler::Stage indexStage(profiler, "index torrents");
+
+    std::vector<TorrentEntry> torrents(paths.size());
+    std::atomic<size_t> nextIndex{0};
+    std::atomic<uint64_t> totalBytesRead{0};
+
+    auto indexTorrents = [&]() {
+        std::vector<uint8_t> buffer;
+        uint64_t bytesRead = 0;
+
+        for (size_t i = nextIndex++; i < paths.size(); i = nextIndex++)
+        {
+            if (!readWholeFile(paths[i], buffer))
+            {
+                setFailed(torrents[i], TorrentStatus::ReadError);
+                continue;
+            }
+
+            bytesRead += buffer.size();
+            indexTorrent(buffer.data(), buffer.size(), torrents[i]);
+        }
+
+        totalBytesRead += bytesRead;
+    };
+
+    unsigned int threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+    std::vector<std::thread> threads;
+    for (unsigned int i = 0; i < threadCount; ++i)
+    {
+        threads.emplace_back(indexTorrents);
+    }
+
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+
+    indexStage.end(totalBytesRead);
+
+    Profiler::Stage writeStage(profiler, "write index");
+    if (!writeIndex(outputPath, paths, torrents))
+    {
+        std::cerr << "Cannot write the output file: " << outputPath << std::endl;
+        return 1;
+    }
+
+    writeStage.end(0);
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    size_t failedCount = std::count_if(torrents.begin(), torrents.end(),
+                                       [](const TorrentEntry& torrent) { return torrent.status != TorrentStatus::Ok; });
+
+    std::cerr << "Indexed " << torrents.size() << " torrents (" << failedCount << " failed), "
+              << totalBytesRead / 1e6 << " MB in " << seconds << " s, " << totalBytesRead / 1e6 / seconds
+              << " MB/s, " << threadCount << " threads, sha-1 backend: " << backendName << std::endl;
+
+    profiler.print(stderr);
+
+    return 0;
+}
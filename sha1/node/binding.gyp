@@ -0,0 +1,17 @@
+{
+    "targets": [
+        {
+            "target_name": "sha1_node",
+            "sources": ["sha1_node.cpp"],
+            "cflags_cc": ["-O3", "-std=gnu++17"],
+            "xcode_settings": {
+                "OTHER_CPLUSPLUSFLAGS": ["-O3", "-std=gnu++17"]
+            },
+            "msvs_settings": {
+                "VCCLCompilerTool": {
+                    "AdditionalOptions": ["/O2", "/std:c++17"]
+                }
+            }
+        }
+    ]
+}
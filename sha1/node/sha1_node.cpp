@@ -0,0 +1,208 @@
+/*
+Node.js native addon, which hashes pieces with the same sha-1 code as the wasm module, compiled natively
+(see sha1_native.h)
+
+Exposes the same contract as Sha1WorkerObject.computeHashes:
+    const { computeHashes, backend } = require("./build/Release/sha1_node.node");
+    const { result, originalInputs } = await computeHashes(inputs); // inputs: Uint8Array[]
+
+The inputs are hashed in place (without copying) on a libuv worker thread, so they must not be modified
+until the returned promise is resolved
+Build with node-gyp in this folder: node-gyp rebuild
+*/
+
+#include <node_api.h>
+
+#include <vector>
+
+#include "../sha1_native.h"
+
+struct HashWork
+{
+    napi_async_work work = nullptr;
+    napi_deferred deferred = nullptr;
+    // The array is returned as originalInputs
+    napi_ref inputsRef = nullptr;
+    // Keep each input alive while it's hashed, even if it's removed from the array in the meantime
+    std::vector<napi_ref> inputRefs;
+
+    std::vector<const _uint8_t*> inputData;
+    std::vector<size_t> inputLengths;
+    std::vector<_uint8_t> result;
+};
+
+static void executeHashWork(napi_env, void* data)
+{
+    HashWork* hashWork = (HashWork*)data;
+
+    for (size_t i = 0; i < hashWork->inputData.size(); ++i)
+    {
+        hashMessage(hashWork->inputData[i], hashWork->inputLengths[i], hashWork->result.data() + i * 20);
+    }
+}
+
+static void completeHashWork(napi_env env, napi_status status, void* data)
+{
+    HashWork* hashWork = (HashWork*)data;
+
+    napi_value inputs;
+    napi_get_reference_value(env, hashWork->inputsRef, &inputs);
+
+    if (status == napi_ok)
+    {
+        void* resultData;
+        napi_value resultBuffer;
+        napi_value resultArray;
+        napi_create_arraybuffer(env, hashWork->result.size(), &resultData, &resultBuffer);
+        memcpy(resultData, hashWork->result.data(), hashWork->result.size());
+        napi_create_typedarray(env, napi_uint8_array, hashWork->result.size(), resultBuffer, 0, &resultArray);
+
+        napi_value resultObject;
+        napi_create_object(env, &resultObject);
+        napi_set_named_property(env, resultObject, "result", resultArray);
+        napi_set_named_property(env, resultObject, "originalInputs", inputs);
+
+        napi_resolve_deferred(env, hashWork->deferred, resultObject);
+    }
+    else
+    {
+        napi_value message;
+        napi_value error;
+        napi_create_string_utf8(env, "Hashing failed", NAPI_AUTO_LENGTH, &message);
+        napi_create_error(env, nullptr, message, &error);
+        napi_reject_deferred(env, hashWork->deferred, error);
+    }
+
+    napi_delete_reference(env, hashWork->inputsRef);
+    for (napi_ref inputRef : hashWork->inputRefs)
+    {
+        napi_delete_reference(env, inputRef);
+    }
+
+    napi_delete_async_work(env, hashWork->work);
+    delete hashWork;
+}
+
+// For the failure paths before the work is queued, completeHashWork frees the work after that
+static void deleteHashWork(napi_env env, HashWork* hashWork)
+{
+    if (hashWork->inputsRef != nullptr)
+    {
+        napi_delete_reference(env, hashWork->inputsRef);
+    }
+
+    for (napi_ref inputRef : hashWork->inputRefs)
+    {
+        napi_delete_reference(env, inputRef);
+    }
+
+    if (hashWork->work != nullptr)
+    {
+        napi_delete_async_work(env, hashWork->work);
+    }
+
+    delete hashWork;
+}
+
+static napi_value throwError(napi_env env, const char* message)
+{
+    napi_throw_type_error(env, nullptr, message);
+    return nullptr;
+}
+
+// computeHashes(inputs: Uint8Array[]): Promise<{ result: Uint8Array; originalInputs: Uint8Array[] }>
+static napi_value computeHashes(napi_env env, napi_callback_info info)
+{
+    size_t argc = 1;
+    napi_value inputs;
+    napi_get_cb_info(env, info, &argc, &inputs, nullptr, nullptr);
+
+    bool isArray = false;
+    if (argc < 1 || napi_is_array(env, inputs, &isArray) != napi_ok || !isArray)
+    {
+        return throwError(env, "Expected an array of Uint8Arrays");
+    }
+
+    uint32_t inputCount;
+    napi_get_array_length(env, inputs, &inputCount);
+
+    HashWork* hashWork = new HashWork();
+    hashWork->inputData.resize(inputCount);
+    hashWork->inputLengths.resize(inputCount);
+    hashWork->result.resize((size_t)inputCount * 20);
+    hashWork->inputRefs.reserve(inputCount);
+
+    for (uint32_t i = 0; i < inputCount; ++i)
+    {
+        napi_value input;
+        napi_get_element(env, inputs, i, &input);
+
+        bool isTypedArray = false;
+        napi_typedarray_type type;
+        size_t length;
+        void* data;
+
+        if (napi_is_typedarray(env, input, &isTypedArray) != napi_ok || !isTypedArray ||
+            napi_get_typedarray_info(env, input, &type, &length, &data, nullptr, nullptr) != napi_ok ||
+            type != napi_uint8_array)
+        {
+            deleteHashWork(env, hashWork);
+            return throwError(env, "Expected an array of Uint8Arrays");
+        }
+
+        // The typed array keeps its ArrayBuffer alive
+        napi_ref inputRef;
+        if (napi_create_reference(env, input, 1, &inputRef) != napi_ok)
+        {
+            deleteHashWork(env, hashWork);
+            return throwError(env, "Failed to create the hashing work");
+        }
+
+        hashWork->inputRefs.push_back(inputRef);
+        hashWork->inputData[i] = (const _uint8_t*)data;
+        hashWork->inputLengths[i] = length;
+    }
+
+    napi_value resourceName;
+    if (napi_create_reference(env, inputs, 1, &hashWork->inputsRef) != napi_ok ||
+        napi_create_string_utf8(env, "sha1_node.computeHashes", NAPI_AUTO_LENGTH, &resourceName) != napi_ok ||
+        napi_create_async_work(env, nullptr, resourceName, executeHashWork, completeHashWork, hashWork,
+                               &hashWork->work) != napi_ok)
+    {
+        deleteHashWork(env, hashWork);
+        return throwError(env, "Failed to create the hashing work");
+    }
+
+    // The promise is created last, so it's only left unsettled if the work can't be queued
+    napi_value promise;
+    if (napi_create_promise(env, &hashWork->deferred, &promise) != napi_ok)
+    {
+        deleteHashWork(env, hashWork);
+        return throwError(env, "Failed to create the promise");
+    }
+
+    if (napi_queue_async_work(env, hashWork->work) != napi_ok)
+    {
+        deleteHashWork(env, hashWork);
+        return throwError(env, "Failed to queue the hashing work");
+    }
+
+    return promise;
+}
+
+static napi_value init(napi_env env, napi_value exports)
+{
+    selectBlocksFunction();
+
+    napi_value computeHashesFunction;
+    napi_value backend;
+    napi_create_function(env, "computeHashes", NAPI_AUTO_LENGTH, computeHashes, nullptr, &computeHashesFunction);
+    napi_create_string_utf8(env, backendName, NAPI_AUTO_LENGTH, &backend);
+
+    napi_set_named_property(env, exports, "computeHashes", computeHashesFunction);
+    napi_set_named_property(env, exports, "backend", backend);
+
+    return exports;
+}
+
+NAPI_MODULE(NODE_GYP_MODULE_NAME, init)
@@ -0,0 +1,294 @@
+/*
+Hardware performance counters for the native tools, used by their --profile option
+
+On Linux, the counters are opened with perf_event_open for the whole process, and the threads which are started after
+that are counted too (inherited counters are added to the process when the threads exit, so a stage has to join its
+threads before it ends). Counters which can't be opened (e.g. because of perf_event_paranoid, a virtual machine
+without a PMU, or another OS) are reported as unavailable, and the stages still report their time and throughput
+*/
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+enum class PerfCounter
+{
+    Cycles,
+    Instructions,
+    LlcMisses,
+    DtlbMisses,
+    BranchMisses,
+    Count
+};
+
+struct PerfCounterValues
+{
+    // -1 if the counter is unavailable
+    int64_t values[(int)PerfCounter::Count];
+
+    int64_t get(PerfCounter counter) const
+    {
+        return values[(int)counter];
+    }
+};
+
+class PerfCounters
+{
+public:
+    PerfCounters()
+    {
+        for (int& fd : fds)
+        {
+            fd = -1;
+        }
+
+#ifdef __linux__
+        open(PerfCounter::Cycles, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+        open(PerfCounter::Instructions, PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+        open(PerfCounter::LlcMisses, PERF_TYPE_HW_CACHE, getCacheConfig(PERF_COUNT_HW_CACHE_LL));
+        open(PerfCounter::DtlbMisses, PERF_TYPE_HW_CACHE, getCacheConfig(PERF_COUNT_HW_CACHE_DTLB));
+        open(PerfCounter::BranchMisses, PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+#endif
+    }
+
+    ~PerfCounters()
+    {
+#ifdef __linux__
+        for (int fd : fds)
+        {
+            if (fd != -1)
+            {
+                close(fd);
+            }
+        }
+#endif
+    }
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    bool isAnyAvailable() const
+    {
+        for (int fd : fds)
+        {
+            if (fd != -1)
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    // Current values, scaled up if the kernel multiplexed the counters
+    PerfCounterValues read() const
+    {
+        PerfCounterValues result;
+
+        for (int i = 0; i < (int)PerfCounter::Count; ++i)
+        {
+            result.values[i] = -1;
+
+#ifdef __linux__
+            // Value, time enabled, time running
+            uint64_t data[3];
+            if (fds[i] != -1 && ::read(fds[i], data, sizeof(data)) == (ssize_t)sizeof(data))
+            {
+                double scale = data[2] == 0 ? 0 : (double)data[1] / (double)data[2];
+                result.values[i] = (int64_t)((double)data[0] * scale);
+            }
+#endif
+        }
+
+        return result;
+    }
+
+    // Explains why no counters are available
+    static std::string getUnavailableReason()
+    {
+#ifdef __linux__
+        std::string reason = "hardware counters are not available";
+
+        FILE* file = fopen("/proc/sys/kernel/perf_event_paranoid", "rb");
+        if (file != nullptr)
+        {
+            int paranoid = 0;
+            if (fscanf(file, "%d", &paranoid) == 1 && paranoid > 1)
+            {
+                reason += " (kernel.perf_event_paranoid is " + std::to_string(paranoid) + ", it should be 1 or less)";
+            }
+
+            fclose(file);
+        }
+
+        return reason;
+#else
+        return "hardware counters are only supported on Linux";
+#endif
+    }
+
+private:
+#ifdef __linux__
+    static uint64_t getCacheConfig(uint64_t cache)
+    {
+        return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    }
+
+    void open(PerfCounter counter, uint32_t type, uint64_t config)
+    {
+        perf_event_attr attributes = {};
+        attributes.size = sizeof(attributes);
+        attributes.type = type;
+        attributes.config = config;
+        attributes.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        attributes.inherit = 1;
+        attributes.exclude_kernel = 1;
+        attributes.exclude_hv = 1;
+
+        // Whole process, on any CPU
+        fds[(int)counter] = (int)syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0);
+    }
+#endif
+
+    int fds[(int)PerfCounter::Count];
+};
+
+struct ProfileStageResult
+{
+    std::string name;
+    uint64_t byteCount;
+    double seconds;
+    PerfCounterValues counters;
+};
+
+// Collects the counters of the stages of a run, and prints them at the end
+// When it's disabled, the stages are not measured
+class Profiler
+{
+public:
+    explicit Profiler(bool isEnabled)
+    {
+        if (isEnabled)
+        {
+            counters.reset(new PerfCounters());
+        }
+    }
+
+    bool isEnabled() const
+    {
+        return counters != nullptr;
+    }
+
+    // Measures a stage from its construction to end(), which processes byteCount bytes
+    class Stage
+    {
+    public:
+        Stage(Profiler& profiler, const char* name) : profiler(profiler), name(name)
+        {
+            if (profiler.isEnabled())
+            {
+                startCounters = profiler.counters->read();
+                startTime = std::chrono::steady_clock::now();
+            }
+        }
+
+        void end(uint64_t byteCount)
+        {
+            if (!profiler.isEnabled())
+            {
+                return;
+            }
+
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+            PerfCounterValues endCounters = profiler.counters->read();
+
+            ProfileStageResult result = {name, byteCount, seconds, endCounters};
+            for (int i = 0; i < (int)PerfCounter::Count; ++i)
+            {
+                if (startCounters.values[i] >= 0 && endCounters.values[i] >= 0)
+                {
+                    result.counters.values[i] = endCounters.values[i] - startCounters.values[i];
+                }
+            }
+
+            profiler.stages.push_back(result);
+        }
+
+    private:
+        Profiler& profiler;
+        std::string name;
+        PerfCounterValues startCounters = {};
+        std::chrono::steady_clock::time_point startTime;
+    };
+
+    void print(FILE* output) const
+    {
+        if (!isEnabled())
+        {
+            return;
+        }
+
+        if (!counters->isAnyAvailable())
+        {
+            fprintf(output, "Profile: %s\n", PerfCounters::getUnavailableReason().c_str());
+        }
+
+        fprintf(output, "%-24s %12s %10s %10s %10s %8s %12s %12s %12s\n", "stage", "MB", "seconds", "MB/s",
+                "cycles/B", "IPC", "LLC miss", "dTLB miss", "br miss");
+
+        for (const ProfileStageResult& stage : stages)
+        {
+            int64_t cycles = stage.counters.get(PerfCounter::Cycles);
+            int64_t instructions = stage.counters.get(PerfCounter::Instructions);
+
+            fprintf(output, "%-24s %12.2f %10.3f %10.1f", stage.name.c_str(), stage.byteCount / 1e6, stage.seconds,
+                    stage.seconds == 0 ? 0.0 : stage.byteCount / 1e6 / stage.seconds);
+
+            printRatio(output, 10, cycles, (int64_t)stage.byteCount);
+            printRatio(output, 8, instructions, cycles);
+            printCount(output, stage.counters.get(PerfCounter::LlcMisses));
+            printCount(output, stage.counters.get(PerfCounter::DtlbMisses));
+            printCount(output, stage.counters.get(PerfCounter::BranchMisses));
+            fprintf(output, "\n");
+        }
+    }
+
+private:
+    static void printRatio(FILE* output, int width, int64_t numerator, int64_t denominator)
+    {
+        if (numerator < 0 || denominator <= 0)
+        {
+            fprintf(output, " %*s", width, "n/a");
+        }
+        else
+        {
+            fprintf(output, " %*.3f", width, (double)numerator / (double)denominator);
+        }
+    }
+
+    static void printCount(FILE* output, int64_t count)
+    {
+        if (count < 0)
+        {
+            fprintf(output, " %12s", "n/a");
+        }
+        else
+        {
+            fprintf(output, " %12lld", (long long)count);
+        }
+    }
+
+    std::unique_ptr<PerfCounters> counters;
+    std::vector<ProfileStageResult> stages;
+};
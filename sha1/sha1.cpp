@@ -6,13 +6,20 @@
 #define EMSCRIPTEN_KEEPALIVE
 #endif
 
+#ifdef __wasm_simd128__
+#include <wasm_simd128.h>
+#endif
+
 using _size_t = unsigned int; // 4-bytes in webassembly
 using _uint64_t = unsigned long long;
 using _uint8_t = unsigned char;
 using _uint32_t = unsigned int;
 using _int32_t = int;
 
-// The max block size for a torrent is 16MB, and the sha-1 hash can add an extra 64-byte block at the end
+// The sha1 function hashes a whole piece from the buffer, and the sha-1 hash can add an extra 64-byte block at the end
+// The segment functions hash from a whole batch, which is 16MB
+// Batches which don't fit (larger pieces, or a piece carried over from the previous batch when per-subfolder torrents
+// are created) are hashed in parts with sha1SegmentsUpdate, so they don't need a larger buffer
 static constexpr _size_t maxBufferSize = 16 * 1024 * 1024 + 64;
 static _uint8_t memoryBuffer[maxBufferSize];
 static _uint8_t resultBuffer[20];
@@ -22,51 +29,96 @@ extern "C" EMSCRIPTEN_KEEPALIVE _uint8_t* getMemoryBuffer()
     return memoryBuffer;
 }
 
-extern "C" EMSCRIPTEN_KEEPALIVE const _uint8_t* sha1(_size_t sizeInBytes)
+#ifdef __wasm_simd128__
+// Loads four 32-bit big-endian words
+static inline v128_t loadBigEndianWords(const _uint8_t* source)
 {
-    // https://en.wikipedia.org/wiki/SHA-1#SHA-1_pseudocode
+    v128_t words = wasm_v128_load(source);
+    return wasm_i8x16_shuffle(words, words, 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+}
 
-    _uint64_t ml = (_uint64_t)sizeInBytes * 8; // Message length in bits
+static inline v128_t rotateLeft1(v128_t words)
+{
+    return wasm_v128_or(wasm_i32x4_shl(words, 1), wasm_u32x4_shr(words, 31));
+}
 
-    _size_t writeIndex = sizeInBytes;
+// Computes the message schedule words w[j], w[j + 1], w[j + 2], w[j + 3]
+// from w[j - 16 .. j - 13], w[j - 12 .. j - 9], w[j - 8 .. j - 5] and w[j - 4 .. j - 1]
+static inline v128_t messageScheduleNext(v128_t wMinus16, v128_t wMinus12, v128_t wMinus8, v128_t wMinus4)
+{
+    const v128_t zero = wasm_i32x4_splat(0);
 
-    // Append the bit '1' to the message
-    memoryBuffer[writeIndex++] = 0x80;
+    // w[j - 14 .. j - 11]
+    v128_t wMinus14 = wasm_i32x4_shuffle(wMinus16, wMinus12, 2, 3, 4, 5);
 
-    // Append 0 <= k < 512 bits '0', such that the resulting message length in bits is congruent to 448 (mod 512)
-    // Which is 0 <= k < 64 bytes, and is congruent to 56 mod 64
-    while ((writeIndex & 63) != 56)
-    {
-        memoryBuffer[writeIndex++] = 0;
-    }
+    // w[j - 3 .. j - 1], the last lane would need w[j], which is not calculated yet
+    v128_t wMinus3 = wasm_i32x4_shuffle(wMinus4, zero, 1, 2, 3, 4);
 
-    // Append ml, the original message length in bits, as a 64-bit big-endian integer
-    for (_size_t i = 0; i < 8; ++i)
-    {
-        _size_t shift = (7 - i) * 8;
-        memoryBuffer[writeIndex++] = (_uint8_t)((ml >> shift) & 0xff);
-    }
+    v128_t n = wasm_v128_xor(wasm_v128_xor(wMinus16, wMinus14), wasm_v128_xor(wMinus8, wMinus3));
+    v128_t result = rotateLeft1(n);
 
-    // Process the message in successive 512-bit chunks
+    // Add the missing w[j] term to the last lane, rotation can be done separately since it distributes over xor
+    v128_t missing = wasm_i32x4_shuffle(result, zero, 4, 4, 4, 0);
+    return wasm_v128_xor(result, rotateLeft1(missing));
+}
+#endif
 
-    _uint32_t h0 = 0x67452301;
-    _uint32_t h1 = 0xEFCDAB89;
-    _uint32_t h2 = 0x98BADCFE;
-    _uint32_t h3 = 0x10325476;
-    _uint32_t h4 = 0xC3D2E1F0;
+// Processes the given number of 64-byte blocks, and updates the hash state
+static void sha1Blocks(_uint32_t state[5], const _uint8_t* data, _size_t blockCount)
+{
+    _uint32_t h0 = state[0];
+    _uint32_t h1 = state[1];
+    _uint32_t h2 = state[2];
+    _uint32_t h3 = state[3];
+    _uint32_t h4 = state[4];
 
     _uint32_t w[80];
-    for (_size_t i = 0; i < writeIndex;)
+
+#ifdef __wasm_simd128__
+    const v128_t roundConstants[4] = {
+        wasm_i32x4_splat(0x5A827999),
+        wasm_i32x4_splat(0x6ED9EBA1),
+        wasm_i32x4_splat(0x8F1BBCDC),
+        wasm_i32x4_splat(0xCA62C1D6),
+    };
+
+    // The round constants are already added to w[j] when calculating the message schedule
+#define W_PLUS_K(j, k) w[j]
+#else
+#define W_PLUS_K(j, k) (w[j] + k)
+#endif
+
+    for (_size_t i = 0; i < blockCount * 64;)
     {
+#ifdef __wasm_simd128__
+        // Break chunk into sixteen 32-bit big-endian words, and extend them into eighty words, four words at a time
+
+        v128_t schedule[20];
+        schedule[0] = loadBigEndianWords(data + i);
+        schedule[1] = loadBigEndianWords(data + i + 16);
+        schedule[2] = loadBigEndianWords(data + i + 32);
+        schedule[3] = loadBigEndianWords(data + i + 48);
+        i += 64;
+
+        for (_size_t j = 4; j < 20; ++j)
+        {
+            schedule[j] = messageScheduleNext(schedule[j - 4], schedule[j - 3], schedule[j - 2], schedule[j - 1]);
+        }
+
+        for (_size_t j = 0; j < 20; ++j)
+        {
+            wasm_v128_store(w + j * 4, wasm_i32x4_add(schedule[j], roundConstants[j / 5]));
+        }
+#else
         // Break chunk into sixteen 32-bit big-endian words w[j], 0 <= j < 16
 
 #define CHUNK_UNROLL(j)                                         \
         do                                                      \
         {                                                       \
-            _uint32_t b0 = (_uint32_t)memoryBuffer[i++];        \
-            _uint32_t b1 = (_uint32_t)memoryBuffer[i++];        \
-            _uint32_t b2 = (_uint32_t)memoryBuffer[i++];        \
-            _uint32_t b3 = (_uint32_t)memoryBuffer[i++];        \
+            _uint32_t b0 = (_uint32_t)data[i++];        \
+            _uint32_t b1 = (_uint32_t)data[i++];        \
+            _uint32_t b2 = (_uint32_t)data[i++];        \
+            _uint32_t b3 = (_uint32_t)data[i++];        \
             w[j] = (b0 << 24) | (b1 << 16) | (b2 << 8) | b3;    \
         } while(0)
 
@@ -160,6 +212,7 @@ extern "C" EMSCRIPTEN_KEEPALIVE const _uint8_t* sha1(_size_t sizeInBytes)
         MESSAGE_SCHEDULE(77);
         MESSAGE_SCHEDULE(78);
         MESSAGE_SCHEDULE(79);
+#endif
 
         // Initialize hash value for this chunk
         _uint32_t a = h0;
@@ -180,28 +233,28 @@ extern "C" EMSCRIPTEN_KEEPALIVE const _uint8_t* sha1(_size_t sizeInBytes)
 #define MAIN_LOOP_0_20(j)                                                                                                   \
         do                                                                                                                  \
         {                                                                                                                   \
-            _uint32_t temp = (((a << 5) | (a >> 27)) + ((b & c) | (~b & d)) + e + w[j] + 0x5A827999) & 0x0ffffffff;         \
+            _uint32_t temp = (((a << 5) | (a >> 27)) + ((b & c) | (~b & d)) + e + W_PLUS_K(j, 0x5A827999)) & 0x0ffffffff;   \
             MAIN_LOOP_AFTER                                                                                                 \
         } while(0)
 
 #define MAIN_LOOP_20_40(j)                                                                                                  \
         do                                                                                                                  \
         {                                                                                                                   \
-            _uint32_t temp = (((a << 5) | (a >> 27)) + (b ^ c ^ d) + e + w[j] + 0x6ED9EBA1) & 0x0ffffffff;                  \
+            _uint32_t temp = (((a << 5) | (a >> 27)) + (b ^ c ^ d) + e + W_PLUS_K(j, 0x6ED9EBA1)) & 0x0ffffffff;            \
             MAIN_LOOP_AFTER                                                                                                 \
         } while(0)
 
 #define MAIN_LOOP_40_60(j)                                                                                                  \
         do                                                                                                                  \
         {                                                                                                                   \
-            _uint32_t temp = (((a << 5) | (a >> 27)) + ((b & c) | (b & d) | (c & d)) + e + w[j] + 0x8F1BBCDC) & 0x0ffffffff;\
+            _uint32_t temp = (((a << 5) | (a >> 27)) + ((b & c) | (b & d) | (c & d)) + e + W_PLUS_K(j, 0x8F1BBCDC)) & 0x0ffffffff;\
             MAIN_LOOP_AFTER                                                                                                 \
         } while(0)
 
 #define MAIN_LOOP_60_80(j)                                                                                                  \
         do                                                                                                                  \
         {                                                                                                                   \
-            _uint32_t temp = (((a << 5) | (a >> 27)) + (b ^ c ^ d) + e + w[j] + 0xCA62C1D6) & 0x0ffffffff;                  \
+            _uint32_t temp = (((a << 5) | (a >> 27)) + (b ^ c ^ d) + e + W_PLUS_K(j, 0xCA62C1D6)) & 0x0ffffffff;            \
             MAIN_LOOP_AFTER                                                                                                 \
         } while(0)
 
@@ -297,22 +350,565 @@ extern "C" EMSCRIPTEN_KEEPALIVE const _uint8_t* sha1(_size_t sizeInBytes)
         h4 += e;
     }
 
+    state[0] = h0;
+    state[1] = h1;
+    state[2] = h2;
+    state[3] = h3;
+    state[4] = h4;
+}
+
+static void sha1Init(_uint32_t state[5])
+{
+    state[0] = 0x67452301;
+    state[1] = 0xEFCDAB89;
+    state[2] = 0x98BADCFE;
+    state[3] = 0x10325476;
+    state[4] = 0xC3D2E1F0;
+}
+
+static void sha1StoreResult(const _uint32_t state[5], _uint8_t* destination)
+{
     _size_t resultWriteIndex = 0;
 
 #define WRITE_RESULT_BE(h)                                      \
     do                                                          \
     {                                                           \
-        resultBuffer[resultWriteIndex++] = h >> 24;             \
-        resultBuffer[resultWriteIndex++] = (h >> 16) & 0xff;    \
-        resultBuffer[resultWriteIndex++] = (h >> 8) & 0xff;     \
-        resultBuffer[resultWriteIndex++] = h & 0xff;            \
+        destination[resultWriteIndex++] = h >> 24;              \
+        destination[resultWriteIndex++] = (h >> 16) & 0xff;     \
+        destination[resultWriteIndex++] = (h >> 8) & 0xff;      \
+        destination[resultWriteIndex++] = h & 0xff;             \
     } while(0)
 
-    WRITE_RESULT_BE(h0);
-    WRITE_RESULT_BE(h1);
-    WRITE_RESULT_BE(h2);
-    WRITE_RESULT_BE(h3);
-    WRITE_RESULT_BE(h4);
+    WRITE_RESULT_BE(state[0]);
+    WRITE_RESULT_BE(state[1]);
+    WRITE_RESULT_BE(state[2]);
+    WRITE_RESULT_BE(state[3]);
+    WRITE_RESULT_BE(state[4]);
+}
 
+static const _uint8_t* sha1WriteResult(const _uint32_t state[5])
+{
+    sha1StoreResult(state, resultBuffer);
     return resultBuffer;
 }
+
+// Appends the padding to the last partial block of a message, which has the given length (0 <= length < 64)
+// The tail buffer must be 128 bytes long, returns the number of blocks in it (1 or 2)
+static _size_t sha1PadTail(_uint8_t tail[128], _size_t length, _uint64_t totalLength)
+{
+    // Append the bit '1', then zeros until the length is 56 mod 64, then the message length in bits
+    tail[length++] = 0x80;
+
+    _size_t paddedLength = length <= 56 ? 64 : 128;
+    while (length < paddedLength - 8)
+    {
+        tail[length++] = 0;
+    }
+
+    _uint64_t ml = totalLength * 8;
+    for (_size_t i = 0; i < 8; ++i)
+    {
+        _size_t shift = (7 - i) * 8;
+        tail[length++] = (_uint8_t)((ml >> shift) & 0xff);
+    }
+
+    return paddedLength / 64;
+}
+
+extern "C" EMSCRIPTEN_KEEPALIVE const _uint8_t* sha1(_size_t sizeInBytes)
+{
+    // https://en.wikipedia.org/wiki/SHA-1#SHA-1_pseudocode
+
+    _uint64_t ml = (_uint64_t)sizeInBytes * 8; // Message length in bits
+
+    _size_t writeIndex = sizeInBytes;
+
+    // Append the bit '1' to the message
+    memoryBuffer[writeIndex++] = 0x80;
+
+    // Append 0 <= k < 512 bits '0', such that the resulting message length in bits is congruent to 448 (mod 512)
+    // Which is 0 <= k < 64 bytes, and is congruent to 56 mod 64
+    while ((writeIndex & 63) != 56)
+    {
+        memoryBuffer[writeIndex++] = 0;
+    }
+
+    // Append ml, the original message length in bits, as a 64-bit big-endian integer
+    for (_size_t i = 0; i < 8; ++i)
+    {
+        _size_t shift = (7 - i) * 8;
+        memoryBuffer[writeIndex++] = (_uint8_t)((ml >> shift) & 0xff);
+    }
+
+    // Process the message in successive 512-bit chunks
+
+    _uint32_t state[5];
+    sha1Init(state);
+    sha1Blocks(state, memoryBuffer, writeIndex / 64);
+
+    return sha1WriteResult(state);
+}
+
+// Scatter-gather input: a message is a list of (offset, length) segments of the memory buffer, which are hashed as if
+// they were concatenated, so data from multiple buffers (e.g. a piece which spans multiple files) doesn't need to be
+// copied into a contiguous buffer first
+// Unlike sha1, this doesn't write the padding into the input, so multiple messages can be next to each other in memory
+static constexpr _size_t maxSegmentCount = 4096;
+static _uint32_t segmentTable[maxSegmentCount * 2];
+
+extern "C" EMSCRIPTEN_KEEPALIVE _uint32_t* getSegmentTable()
+{
+    return segmentTable;
+}
+
+// Pieces can be larger than the memory buffer (32MB and 64MB pieces), so a message can also be hashed with multiple
+// calls: sha1SegmentsBegin, then sha1SegmentsUpdate for each part of the message which is copied into the memory buffer,
+// then sha1SegmentsEnd
+// The state of the message is kept here between the calls
+struct Sha1Stream
+{
+    _uint32_t state[5];
+    // Blocks which span multiple segments are collected here, and the padding is added here at the end
+    _uint8_t block[128];
+    _size_t blockLength;
+    _uint64_t totalLength;
+};
+
+static Sha1Stream segmentStream;
+
+extern "C" EMSCRIPTEN_KEEPALIVE void sha1SegmentsBegin()
+{
+    sha1Init(segmentStream.state);
+    segmentStream.blockLength = 0;
+    segmentStream.totalLength = 0;
+}
+
+static void sha1StreamUpdate(Sha1Stream& stream, const _uint8_t* data, _size_t length)
+{
+    stream.totalLength += length;
+
+    if (stream.blockLength != 0)
+    {
+        while (stream.blockLength < 64 && length != 0)
+        {
+            stream.block[stream.blockLength++] = *data++;
+            --length;
+        }
+
+        if (stream.blockLength < 64)
+        {
+            return;
+        }
+
+        sha1Blocks(stream.state, stream.block, 1);
+        stream.blockLength = 0;
+    }
+
+    // Full blocks are processed directly from the data
+    _size_t blockCount = length / 64;
+    sha1Blocks(stream.state, data, blockCount);
+    data += blockCount * 64;
+    length -= blockCount * 64;
+
+    while (length != 0)
+    {
+        stream.block[stream.blockLength++] = *data++;
+        --length;
+    }
+}
+
+extern "C" EMSCRIPTEN_KEEPALIVE void sha1SegmentsUpdate(_size_t segmentCount)
+{
+    for (_size_t segmentIndex = 0; segmentIndex < segmentCount && segmentIndex < maxSegmentCount; ++segmentIndex)
+    {
+        const _uint8_t* data = memoryBuffer + segmentTable[segmentIndex * 2];
+        _size_t length = segmentTable[segmentIndex * 2 + 1];
+        sha1StreamUpdate(segmentStream, data, length);
+    }
+}
+
+extern "C" EMSCRIPTEN_KEEPALIVE const _uint8_t* sha1SegmentsEnd()
+{
+    Sha1Stream& stream = segmentStream;
+    sha1Blocks(stream.state, stream.block, sha1PadTail(stream.block, stream.blockLength, stream.totalLength));
+
+    return sha1WriteResult(stream.state);
+}
+
+extern "C" EMSCRIPTEN_KEEPALIVE const _uint8_t* sha1Segments(_size_t segmentCount)
+{
+    sha1SegmentsBegin();
+    sha1SegmentsUpdate(segmentCount);
+    return sha1SegmentsEnd();
+}
+
+// Fused single pass: hashes a piece like sha1Segments, and runs the other enabled per-byte computations (see
+// FusedFeature) over the same data
+// The segments are processed in tiles, and every computation runs over a tile before moving on to the next one, so the
+// tile is still in the cache: extra computations only cost ALU time, they don't read the data from memory again
+static constexpr _size_t fusedTileSize = 16 * 1024;
+
+enum FusedFeature : _uint32_t
+{
+    // Sets fusedFlagAllZero in the result flags if every byte of the piece is zero
+    fusedDetectZero = 1,
+};
+
+static constexpr _uint32_t fusedFlagAllZero = 1;
+
+// The hash, followed by the result flags (little-endian)
+static _uint8_t fusedResultBuffer[24];
+
+static bool isTileZero(const _uint8_t* data, _size_t length)
+{
+    _size_t offset = 0;
+
+#ifdef __wasm_simd128__
+    v128_t bits = wasm_i32x4_splat(0);
+    for (; offset + 16 <= length; offset += 16)
+    {
+        bits = wasm_v128_or(bits, wasm_v128_load(data + offset));
+    }
+
+    if (wasm_v128_any_true(bits))
+    {
+        return false;
+    }
+#endif
+
+    _uint8_t remainingBits = 0;
+    for (; offset < length; ++offset)
+    {
+        remainingBits |= data[offset];
+    }
+
+    return remainingBits == 0;
+}
+
+extern "C" EMSCRIPTEN_KEEPALIVE const _uint8_t* sha1SegmentsFused(_size_t segmentCount, _uint32_t features)
+{
+    sha1SegmentsBegin();
+
+    bool isAllZero = true;
+
+    for (_size_t segmentIndex = 0; segmentIndex < segmentCount && segmentIndex < maxSegmentCount; ++segmentIndex)
+    {
+        const _uint8_t* data = memoryBuffer + segmentTable[segmentIndex * 2];
+        _size_t length = segmentTable[segmentIndex * 2 + 1];
+
+        for (_size_t tileOffset = 0; tileOffset < length; tileOffset += fusedTileSize)
+        {
+            const _uint8_t* tile = data + tileOffset;
+            _size_t tileLength = length - tileOffset < fusedTileSize ? length - tileOffset : fusedTileSize;
+
+            sha1StreamUpdate(segmentStream, tile, tileLength);
+
+            if ((features & fusedDetectZero) && isAllZero)
+            {
+                isAllZero = isTileZero(tile, tileLength);
+            }
+        }
+    }
+
+    const _uint8_t* hash = sha1SegmentsEnd();
+    for (_size_t i = 0; i < 20; ++i)
+    {
+        fusedResultBuffer[i] = hash[i];
+    }
+
+    _uint32_t flags = (features & fusedDetectZero) && isAllZero ? fusedFlagAllZero : 0;
+    for (_size_t i = 0; i < 4; ++i)
+    {
+        fusedResultBuffer[20 + i] = (_uint8_t)(flags >> (i * 8));
+    }
+
+    return fusedResultBuffer;
+}
+
+// Multi-buffer hashing: hashes multiple messages at once, each message is an (offset, length) pair of the memory buffer
+// The hashes are written after each other into the multi result buffer
+// With SIMD, four messages are hashed at the same time, one in each lane
+// Messages can have different lengths: when a lane finishes its message, it's refilled with the next message,
+// so the lanes are kept busy until there are no more messages
+static constexpr _size_t maxMessageCount = 4096;
+static _uint32_t messageTable[maxMessageCount * 2];
+static _uint8_t multiResultBuffer[maxMessageCount * 20];
+
+extern "C" EMSCRIPTEN_KEEPALIVE _uint32_t* getMessageTable()
+{
+    return messageTable;
+}
+
+#ifdef __wasm_simd128__
+static constexpr _size_t laneCount = 4;
+
+struct Sha1Lane
+{
+    const _uint8_t* data; // Next full block of the message
+    _size_t fullBlockCount;
+    _uint8_t tail[128]; // Last partial block of the message with the padding
+    _size_t tailBlockCount;
+    _size_t tailBlockIndex;
+    _size_t messageIndex;
+    bool isActive;
+};
+
+static void startLane(Sha1Lane& lane, _size_t messageIndex)
+{
+    const _uint8_t* data = memoryBuffer + messageTable[messageIndex * 2];
+    _size_t length = messageTable[messageIndex * 2 + 1];
+
+    lane.data = data;
+    lane.fullBlockCount = length / 64;
+
+    _size_t tailLength = length % 64;
+    const _uint8_t* tailData = data + lane.fullBlockCount * 64;
+    for (_size_t i = 0; i < tailLength; ++i)
+    {
+        lane.tail[i] = tailData[i];
+    }
+
+    lane.tailBlockCount = sha1PadTail(lane.tail, tailLength, length);
+    lane.tailBlockIndex = 0;
+    lane.messageIndex = messageIndex;
+    lane.isActive = true;
+}
+
+static const _uint8_t* nextLaneBlock(Sha1Lane& lane)
+{
+    if (lane.fullBlockCount != 0)
+    {
+        const _uint8_t* block = lane.data;
+        lane.data += 64;
+        --lane.fullBlockCount;
+        return block;
+    }
+
+    return lane.tail + 64 * lane.tailBlockIndex++;
+}
+
+static inline bool isLaneFinished(const Sha1Lane& lane)
+{
+    return lane.fullBlockCount == 0 && lane.tailBlockIndex == lane.tailBlockCount;
+}
+
+static inline v128_t rotateLeft(v128_t words, _uint32_t count)
+{
+    return wasm_v128_or(wasm_i32x4_shl(words, count), wasm_u32x4_shr(words, 32 - count));
+}
+
+// Processes one block for each lane, lane i of the state vectors contains the hash state of lane i
+static void sha1BlocksLanes(v128_t state[5], const _uint8_t* const blocks[laneCount])
+{
+    // Load the words of the blocks, and transpose them, so w[j] contains word j of each block
+    v128_t w[16];
+    for (_size_t j = 0; j < 16; j += 4)
+    {
+        v128_t r0 = loadBigEndianWords(blocks[0] + j * 4);
+        v128_t r1 = loadBigEndianWords(blocks[1] + j * 4);
+        v128_t r2 = loadBigEndianWords(blocks[2] + j * 4);
+        v128_t r3 = loadBigEndianWords(blocks[3] + j * 4);
+
+        v128_t t0 = wasm_i32x4_shuffle(r0, r1, 0, 4, 1, 5);
+        v128_t t1 = wasm_i32x4_shuffle(r2, r3, 0, 4, 1, 5);
+        v128_t t2 = wasm_i32x4_shuffle(r0, r1, 2, 6, 3, 7);
+        v128_t t3 = wasm_i32x4_shuffle(r2, r3, 2, 6, 3, 7);
+
+        w[j] = wasm_i32x4_shuffle(t0, t1, 0, 1, 4, 5);
+        w[j + 1] = wasm_i32x4_shuffle(t0, t1, 2, 3, 6, 7);
+        w[j + 2] = wasm_i32x4_shuffle(t2, t3, 0, 1, 4, 5);
+        w[j + 3] = wasm_i32x4_shuffle(t2, t3, 2, 3, 6, 7);
+    }
+
+    v128_t a = state[0];
+    v128_t b = state[1];
+    v128_t c = state[2];
+    v128_t d = state[3];
+    v128_t e = state[4];
+
+    for (_size_t j = 0; j < 80; ++j)
+    {
+        // The message schedule is calculated on the fly, only the last 16 words are kept
+        if (j >= 16)
+        {
+            v128_t n = wasm_v128_xor(
+                wasm_v128_xor(w[(j - 3) & 15], w[(j - 8) & 15]),
+                wasm_v128_xor(w[(j - 14) & 15], w[j & 15]));
+            w[j & 15] = rotateLeft(n, 1);
+        }
+
+        v128_t f;
+        _uint32_t k;
+        if (j < 20)
+        {
+            f = wasm_v128_bitselect(c, d, b);
+            k = 0x5A827999;
+        }
+        else if (j < 40)
+        {
+            f = wasm_v128_xor(wasm_v128_xor(b, c), d);
+            k = 0x6ED9EBA1;
+        }
+        else if (j < 60)
+        {
+            f = wasm_v128_or(wasm_v128_and(b, c), wasm_v128_and(wasm_v128_or(b, c), d));
+            k = 0x8F1BBCDC;
+        }
+        else
+        {
+            f = wasm_v128_xor(wasm_v128_xor(b, c), d);
+            k = 0xCA62C1D6;
+        }
+
+        v128_t temp = wasm_i32x4_add(
+            wasm_i32x4_add(rotateLeft(a, 5), f),
+            wasm_i32x4_add(wasm_i32x4_add(e, wasm_i32x4_splat(k)), w[j & 15]));
+
+        e = d;
+        d = c;
+        c = rotateLeft(b, 30);
+        b = a;
+        a = temp;
+    }
+
+    state[0] = wasm_i32x4_add(state[0], a);
+    state[1] = wasm_i32x4_add(state[1], b);
+    state[2] = wasm_i32x4_add(state[2], c);
+    state[3] = wasm_i32x4_add(state[3], d);
+    state[4] = wasm_i32x4_add(state[4], e);
+}
+#endif
+
+extern "C" EMSCRIPTEN_KEEPALIVE const _uint8_t* sha1Multi(_size_t messageCount)
+{
+    if (messageCount > maxMessageCount)
+    {
+        messageCount = maxMessageCount;
+    }
+
+    _size_t nextMessageIndex = 0;
+
+#ifdef __wasm_simd128__
+    Sha1Lane lanes[laneCount];
+    _size_t activeLaneCount = 0;
+
+    for (_size_t i = 0; i < laneCount; ++i)
+    {
+        lanes[i].isActive = false;
+        if (nextMessageIndex < messageCount)
+        {
+            startLane(lanes[i], nextMessageIndex++);
+            ++activeLaneCount;
+        }
+    }
+
+    _uint32_t initialState[5];
+    sha1Init(initialState);
+
+    v128_t state[5];
+    for (_size_t i = 0; i < 5; ++i)
+    {
+        state[i] = wasm_i32x4_splat(initialState[i]);
+    }
+
+    const v128_t laneMasks[laneCount] = {
+        wasm_i32x4_make(-1, 0, 0, 0),
+        wasm_i32x4_make(0, -1, 0, 0),
+        wasm_i32x4_make(0, 0, -1, 0),
+        wasm_i32x4_make(0, 0, 0, -1),
+    };
+
+    // Idle lanes hash this block, and their results are ignored
+    static const _uint8_t idleBlock[64] = {};
+
+    // Use all lanes while there are at least two messages to hash, the last message is finished without SIMD
+    while (activeLaneCount > 1)
+    {
+        const _uint8_t* blocks[laneCount];
+        for (_size_t i = 0; i < laneCount; ++i)
+        {
+            blocks[i] = lanes[i].isActive ? nextLaneBlock(lanes[i]) : idleBlock;
+        }
+
+        sha1BlocksLanes(state, blocks);
+
+        for (_size_t i = 0; i < laneCount; ++i)
+        {
+            Sha1Lane& lane = lanes[i];
+            if (!lane.isActive || !isLaneFinished(lane))
+            {
+                continue;
+            }
+
+            // Retire the lane: store its result, and refill it with the next message if there is one
+            _uint32_t laneState[5];
+            for (_size_t j = 0; j < 5; ++j)
+            {
+                _uint32_t words[laneCount];
+                wasm_v128_store(words, state[j]);
+                laneState[j] = words[i];
+
+                state[j] = wasm_v128_bitselect(wasm_i32x4_splat(initialState[j]), state[j], laneMasks[i]);
+            }
+
+            sha1StoreResult(laneState, multiResultBuffer + lane.messageIndex * 20);
+
+            if (nextMessageIndex < messageCount)
+            {
+                startLane(lane, nextMessageIndex++);
+            }
+            else
+            {
+                lane.isActive = false;
+                --activeLaneCount;
+            }
+        }
+    }
+
+    // Finish the last message (if any) with the scalar code, continuing from the state of its lane
+    for (_size_t i = 0; i < laneCount; ++i)
+    {
+        Sha1Lane& lane = lanes[i];
+        if (!lane.isActive)
+        {
+            continue;
+        }
+
+        _uint32_t laneState[5];
+        for (_size_t j = 0; j < 5; ++j)
+        {
+            _uint32_t words[laneCount];
+            wasm_v128_store(words, state[j]);
+            laneState[j] = words[i];
+        }
+
+        sha1Blocks(laneState, lane.data, lane.fullBlockCount);
+        sha1Blocks(laneState, lane.tail + 64 * lane.tailBlockIndex, lane.tailBlockCount - lane.tailBlockIndex);
+        sha1StoreResult(laneState, multiResultBuffer + lane.messageIndex * 20);
+    }
+#else
+    for (; nextMessageIndex < messageCount; ++nextMessageIndex)
+    {
+        const _uint8_t* data = memoryBuffer + messageTable[nextMessageIndex * 2];
+        _size_t length = messageTable[nextMessageIndex * 2 + 1];
+
+        _uint32_t state[5];
+        sha1Init(state);
+
+        _size_t fullBlockCount = length / 64;
+        sha1Blocks(state, data, fullBlockCount);
+
+        _uint8_t tail[128];
+        _size_t tailLength = length % 64;
+        for (_size_t i = 0; i < tailLength; ++i)
+        {
+            tail[i] = data[fullBlockCount * 64 + i];
+        }
+
+        sha1Blocks(state, tail, sha1PadTail(tail, tailLength, length));
+        sha1StoreResult(state, multiResultBuffer + nextMessageIndex * 20);
+    }
+#endif
+
+    return multiResultBuffer;
+}
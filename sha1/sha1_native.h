@@ -0,0 +1,234 @@
+/*
+Native builds of the sha-1 code, shared by the Node.js addon, the torrent indexer, the torrent verifier and the kernel
+benchmark
+When the CPU supports the x86 SHA extensions, those are used instead of the portable code
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <utility>
+
+// The block functions of the kernel are reentrant, only its exported entry points use static buffers
+#include "sha1.cpp"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define SHA1_NATIVE_X86
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_SHA_NI
+#else
+#include <cpuid.h>
+#define TARGET_SHA_NI __attribute__((target("sha,sse4.1")))
+#endif
+
+static bool isShaNiSupported()
+{
+    unsigned int registers[4] = {};
+
+#ifdef _MSC_VER
+    __cpuidex((int*)registers, 7, 0);
+#else
+    if (!__get_cpuid_count(7, 0, &registers[0], &registers[1], &registers[2], &registers[3]))
+    {
+        return false;
+    }
+#endif
+
+    // EBX bit 29: SHA extensions
+    return (registers[1] & (1u << 29)) != 0;
+}
+
+// Rounds 4g .. 4g + 3 with the SHA extensions
+// Each group of four rounds uses one of the msg registers, which are extended by the message schedule instructions
+// a few groups ahead
+template <int g>
+TARGET_SHA_NI static inline void sha1RoundsShaNi(__m128i& abcd, __m128i& e0, __m128i& e1, __m128i msg[4],
+                                                 const _uint8_t* data)
+{
+    const __m128i byteSwapMask = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+
+    __m128i& current = msg[g % 4];
+
+    if constexpr (g < 4)
+    {
+        current = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + g * 16)), byteSwapMask);
+    }
+
+    if constexpr (g == 0)
+    {
+        e0 = _mm_add_epi32(e0, current);
+        e1 = abcd;
+        abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+    }
+    else if constexpr (g % 2 == 1)
+    {
+        e1 = _mm_sha1nexte_epu32(e1, current);
+        e0 = abcd;
+        abcd = _mm_sha1rnds4_epu32(abcd, e1, g / 5);
+    }
+    else
+    {
+        e0 = _mm_sha1nexte_epu32(e0, current);
+        e1 = abcd;
+        abcd = _mm_sha1rnds4_epu32(abcd, e0, g / 5);
+    }
+
+    // Message schedule
+    if constexpr (g >= 3 && g <= 18)
+    {
+        msg[(g + 1) % 4] = _mm_sha1msg2_epu32(msg[(g + 1) % 4], current);
+    }
+
+    if constexpr (g >= 1 && g <= 16)
+    {
+        msg[(g + 3) % 4] = _mm_sha1msg1_epu32(msg[(g + 3) % 4], current);
+    }
+
+    if constexpr (g >= 2 && g <= 17)
+    {
+        msg[(g + 2) % 4] = _mm_xor_si128(msg[(g + 2) % 4], current);
+    }
+}
+
+template <int... g>
+TARGET_SHA_NI static inline void sha1AllRoundsShaNi(std::integer_sequence<int, g...>, __m128i& abcd, __m128i& e0,
+                                                    __m128i& e1, __m128i msg[4], const _uint8_t* data)
+{
+    (sha1RoundsShaNi<g>(abcd, e0, e1, msg, data), ...);
+}
+
+// Same as sha1Blocks, using the SHA extensions
+TARGET_SHA_NI static void sha1BlocksShaNi(_uint32_t state[5], const _uint8_t* data, size_t blockCount)
+{
+    __m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)state), 0x1B);
+    __m128i e0 = _mm_set_epi32((int)state[4], 0, 0, 0);
+
+    for (size_t blockIndex = 0; blockIndex < blockCount; ++blockIndex, data += 64)
+    {
+        const __m128i abcdSaved = abcd;
+        const __m128i e0Saved = e0;
+
+        __m128i msg[4];
+        __m128i e1;
+        sha1AllRoundsShaNi(std::make_integer_sequence<int, 20>(), abcd, e0, e1, msg, data);
+
+        // After the last group, e0 contains the state before the last four rounds
+        e0 = _mm_sha1nexte_epu32(e0, e0Saved);
+        abcd = _mm_add_epi32(abcd, abcdSaved);
+    }
+
+    _mm_storeu_si128((__m128i*)state, _mm_shuffle_epi32(abcd, 0x1B));
+    state[4] = (_uint32_t)_mm_extract_epi32(e0, 3);
+}
+#endif
+
+using BlocksFunction = void (*)(_uint32_t state[5], const _uint8_t* data, size_t blockCount);
+
+// sha1Blocks counts in the 32-bit size type of the wasm build, so the blocks are hashed in chunks which fit into it
+static constexpr size_t maxPortableChunkBlockCount = 1 << 20; // 64MB, the byte count of a chunk fits into 32 bits
+
+static void sha1BlocksPortable(_uint32_t state[5], const _uint8_t* data, size_t blockCount)
+{
+    while (blockCount > 0)
+    {
+        const size_t chunkBlockCount = std::min(blockCount, maxPortableChunkBlockCount);
+        sha1Blocks(state, data, (_size_t)chunkBlockCount);
+
+        data += chunkBlockCount * 64;
+        blockCount -= chunkBlockCount;
+    }
+}
+
+static BlocksFunction blocksFunction = sha1BlocksPortable;
+static const char* backendName = "portable";
+
+// Selects the fastest implementation which is supported by the CPU, must be called before hashing
+static void selectBlocksFunction()
+{
+#ifdef SHA1_NATIVE_X86
+    if (isShaNiSupported())
+    {
+        blocksFunction = sha1BlocksShaNi;
+        backendName = "sha-ni";
+    }
+#endif
+}
+
+static void hashMessage(const _uint8_t* data, size_t length, _uint8_t* destination)
+{
+    _uint32_t state[5];
+    sha1Init(state);
+
+    size_t fullBlockCount = length / 64;
+    blocksFunction(state, data, fullBlockCount);
+
+    _uint8_t tail[128];
+    _size_t tailLength = (_size_t)(length % 64);
+    memcpy(tail, data + fullBlockCount * 64, tailLength);
+
+    blocksFunction(state, tail, sha1PadTail(tail, tailLength, length));
+    sha1StoreResult(state, destination);
+}
+
+// Hashes a message which is received in multiple parts, e.g. a piece which is read in chunks
+class Sha1Hasher
+{
+public:
+    Sha1Hasher()
+    {
+        reset();
+    }
+
+    void reset()
+    {
+        sha1Init(state);
+        blockLength = 0;
+        totalLength = 0;
+    }
+
+    void update(const _uint8_t* data, size_t length)
+    {
+        totalLength += length;
+
+        if (blockLength != 0)
+        {
+            size_t copyLength = std::min(length, (size_t)64 - blockLength);
+            memcpy(block + blockLength, data, copyLength);
+            blockLength += copyLength;
+            data += copyLength;
+            length -= copyLength;
+
+            if (blockLength < 64)
+            {
+                return;
+            }
+
+            blocksFunction(state, block, 1);
+            blockLength = 0;
+        }
+
+        // Full blocks are processed directly from the data
+        size_t fullBlockCount = length / 64;
+        blocksFunction(state, data, fullBlockCount);
+
+        blockLength = length % 64;
+        memcpy(block, data + fullBlockCount * 64, blockLength);
+    }
+
+    void finish(_uint8_t* destination)
+    {
+        blocksFunction(state, block, sha1PadTail(block, (_size_t)blockLength, totalLength));
+        sha1StoreResult(state, destination);
+    }
+
+private:
+    _uint32_t state[5];
+    _uint8_t block[128];
+    size_t blockLength;
+    _uint64_t totalLength;
+};
@@ -0,0 +1,777 @@
+/*
+Verifies the data of multiple torrents which share files (e.g. different packagings of the same release), reading
+each file only once
+
+Usage: torrent_verify [--profile] <torrent file> <data path> [<torrent file> <data path> ...]
+The data path is the file of a single-file torrent, or the folder which contains the files of a multi-file torrent
+(the folder which is named after the torrent)
+
+The job planner maps the pieces of every torrent onto the byte ranges of the files on disk, and files with the same
+path are only read once. Each chunk which is read from a file is passed to every torrent which contains that file,
+and each torrent handles its own piece alignment:
+- Pieces which are inside a single file are hashed incrementally, as the chunks of the file are read
+- Pieces which span multiple files are assembled in a separate buffer, since the files are read in any order, and they
+  are hashed when all of their bytes have arrived
+  At most maxPendingSpanningSize bytes of these pieces are buffered at once, the pieces which don't fit are read again
+  from their files after every file was read (e.g. torrents with many small files and large pieces)
+So the amount of data read from disk depends on the number of unique bytes, not on the number of torrents
+Files at different paths which share all of their extents on disk (reflinked copies, snapshots or hard links, see
+file_extents.h) are also read only once, as if they had the same path. When the same data is used by multiple torrents
+with the same piece length and the same piece alignment in the file, the pieces inside the file are only hashed once,
+and their hashes are reused for the other torrents
+
+For each torrent, one line is printed: OK, FAILED or INVALID (the .torrent file can't be read), the number of valid
+pieces, the number of pieces, and the path of the torrent
+The pieces of files whose size on disk is not the length in the torrent are invalid, and these files are listed on
+stderr
+The exit code is 0 if every piece of every torrent is valid, and 2 otherwise
+With --profile, the time and hardware counters of each stage are printed to stderr (see perf_counters.h)
+
+Build with build.bat in this folder
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "../bencode_scanner.h"
+#include "../file_extents.h"
+#include "../perf_counters.h"
+#include "../sha1_native.h"
+
+// Size of the chunks which are read from the files, for each thread
+static constexpr size_t readChunkSize = 16 * 1024 * 1024;
+
+// Larger pieces are not used by any client, torrents with larger pieces are invalid
+static constexpr uint64_t maxPieceLength = 256 * 1024 * 1024;
+
+// Memory of the pieces which span multiple files, and are waiting for the reads of their other files
+static constexpr uint64_t maxPendingSpanningSize = 1024 * 1024 * 1024;
+static std::atomic<uint64_t> pendingSpanningSize{0};
+
+struct TorrentFile
+{
+    uint64_t length = 0;
+    std::vector<std::string> path;
+};
+
+// A piece which spans multiple files, its data is collected from the reads of those files
+struct SpanningPiece
+{
+    std::vector<uint8_t> data;
+    uint64_t receivedLength = 0;
+    // The piece didn't fit into maxPendingSpanningSize, it's read again after the other files, see verifyDeferredPiece
+    bool isDeferred = false;
+};
+
+// A file of a torrent whose size on disk is not the length in the torrent
+struct WrongSizeFile
+{
+    std::string path;
+    uint64_t jobOffset;
+    uint64_t length;
+    uint64_t diskSize;
+};
+
+struct VerifyJob
+{
+    std::string torrentPath;
+    std::filesystem::path dataPath;
+    bool isValid = false;
+
+    uint64_t pieceLength = 0;
+    uint64_t totalLength = 0;
+    std::string_view pieceHashes; // Points into torrentData
+    bool isSingleFile = false;
+    std::vector<TorrentFile> files;
+
+    std::vector<uint8_t> torrentData;
+    std::vector<uint8_t> isPieceValid;
+
+    std::mutex spanningPiecesMutex;
+    std::unordered_map<uint64_t, SpanningPiece> spanningPieces;
+
+    std::mutex wrongSizeFilesMutex;
+    std::vector<WrongSizeFile> wrongSizeFiles;
+
+    uint64_t getPieceCount() const
+    {
+        return (totalLength + pieceLength - 1) / pieceLength;
+    }
+
+    uint64_t getPieceEnd(uint64_t pieceIndex) const
+    {
+        return std::min((pieceIndex + 1) * pieceLength, totalLength);
+    }
+
+    void checkPiece(uint64_t pieceIndex, const uint8_t hash[20])
+    {
+        isPieceValid[pieceIndex] = memcmp(hash, pieceHashes.data() + pieceIndex * 20, 20) == 0;
+    }
+
+    // The pieces of the files with the wrong size are invalid, even if the data at the start of a longer file matches
+    // Called after every file is read, a piece can be completed by the read of another file
+    void invalidateWrongSizeFiles()
+    {
+        for (const WrongSizeFile& file : wrongSizeFiles)
+        {
+            uint64_t endPiece = (file.jobOffset + file.length + pieceLength - 1) / pieceLength;
+            for (uint64_t pieceIndex = file.jobOffset / pieceLength; pieceIndex < endPiece; ++pieceIndex)
+            {
+                isPieceValid[pieceIndex] = 0;
+            }
+        }
+    }
+};
+
+// A range of a file on disk, which is a file of a torrent
+struct FileUse
+{
+    VerifyJob* job;
+    // Position of the file in the concatenated files of the torrent
+    uint64_t jobOffset;
+    uint64_t length;
+};
+
+struct DiskFile
+{
+    std::string path;
+    std::vector<FileUse> uses;
+    uint64_t readLength = 0; // Length of the longest use
+};
+
+// Hashing state of a use while its file is read
+struct UseHashing
+{
+    Sha1Hasher hasher;
+
+    // Pieces which are inside the file, see getInnerPieces
+    uint64_t firstInnerPiece = 0;
+    uint64_t innerPieceCount = 0;
+
+    // Index of an earlier use of the file with the same inner pieces, whose hashes are reused, or -1
+    int sourceUseIndex = -1;
+
+    // Hashes of the inner pieces, only if another use reuses them
+    std::vector<uint8_t> innerHashes;
+    uint64_t innerHashCount = 0;
+};
+
+static bool readWholeFile(const std::string& path, std::vector<uint8_t>& buffer)
+{
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == nullptr)
+    {
+        return false;
+    }
+
+    bool isOk = fseek(file, 0, SEEK_END) == 0;
+    long length = isOk ? ftell(file) : -1;
+    isOk = length >= 0 && fseek(file, 0, SEEK_SET) == 0;
+
+    if (isOk)
+    {
+        buffer.resize((size_t)length);
+        isOk = fread(buffer.data(), 1, buffer.size(), file) == buffer.size();
+    }
+
+    fclose(file);
+    return isOk;
+}
+
+// Path elements which would point outside of the data folder are not allowed
+// Besides the separators, ':' is rejected for drive relative paths (e.g. "C:file") and alternate data streams on
+// Windows, and the path library is asked too, for the root names and directories of the platform
+static bool isSafePathElement(std::string_view element)
+{
+    if (element.empty() || element == "." || element == ".." || element.find_first_of("/\\:") != std::string_view::npos)
+    {
+        return false;
+    }
+
+    std::filesystem::path path = std::filesystem::u8path(element);
+    return !path.has_root_name() && !path.has_root_directory();
+}
+
+static bool readFileEntry(const BencodeScanner& scanner, size_t& position, TorrentFile& file)
+{
+    return scanner.forEachEntry(position, [&](std::string_view key, size_t& valuePosition) {
+        if (key == "length")
+        {
+            int64_t length;
+            if (!scanner.readInteger(valuePosition, length) || length < 0)
+            {
+                return false;
+            }
+
+            file.length = (uint64_t)length;
+            return true;
+        }
+
+        if (key == "path")
+        {
+            return scanner.forEachItem(valuePosition, [&](size_t& itemPosition) {
+                std::string_view element;
+                if (!scanner.readString(itemPosition, element) || !isSafePathElement(element))
+                {
+                    return false;
+                }
+
+                file.path.emplace_back(element);
+                return true;
+            });
+        }
+
+        return scanner.skipValue(valuePosition);
+    });
+}
+
+static bool readInfo(const BencodeScanner& scanner, size_t& position, VerifyJob& job)
+{
+    uint64_t singleFileLength = 0;
+
+    bool isValid = scanner.forEachEntry(position, [&](std::string_view key, size_t& valuePosition) {
+        if (key == "pieces")
+        {
+            return scanner.readString(valuePosition, job.pieceHashes);
+        }
+
+        if (key == "piece length" || key == "length")
+        {
+            int64_t value;
+            if (!scanner.readInteger(valuePosition, value) || value < 0)
+            {
+                return false;
+            }
+
+            if (key == "length")
+            {
+                job.isSingleFile = true;
+                singleFileLength = (uint64_t)value;
+            }
+            else
+            {
+                job.pieceLength = (uint64_t)value;
+            }
+
+            return true;
+        }
+
+        if (key == "files")
+        {
+            return scanner.forEachItem(valuePosition, [&](size_t& itemPosition) {
+                job.files.emplace_back();
+                return readFileEntry(scanner, itemPosition, job.files.back());
+            });
+        }
+
+        return scanner.skipValue(valuePosition);
+    });
+
+    if (job.isSingleFile)
+    {
+        job.files.clear();
+        job.files.push_back({singleFileLength, {}});
+    }
+
+    for (const TorrentFile& file : job.files)
+    {
+        job.totalLength += file.length;
+    }
+
+    return isValid;
+}
+
+static bool loadJob(VerifyJob& job)
+{
+    if (!readWholeFile(job.torrentPath, job.torrentData))
+    {
+        return false;
+    }
+
+    BencodeScanner scanner(job.torrentData.data(), job.torrentData.size());
+
+    bool hasInfo = false;
+    size_t position = 0;
+    bool isValid = scanner.forEachEntry(position, [&](std::string_view key, size_t& valuePosition) {
+        if (key != "info")
+        {
+            return scanner.skipValue(valuePosition);
+        }
+
+        hasInfo = true;
+        return readInfo(scanner, valuePosition, job);
+    });
+
+    if (!isValid || !hasInfo || job.pieceLength == 0 || job.pieceLength > maxPieceLength || job.files.empty() ||
+        job.pieceHashes.size() != job.getPieceCount() * 20)
+    {
+        return false;
+    }
+
+    job.isPieceValid.assign(job.getPieceCount(), 0);
+    return true;
+}
+
+static std::filesystem::path getFilePath(const VerifyJob& job, const TorrentFile& file)
+{
+    std::filesystem::path path = job.dataPath;
+    for (const std::string& element : file.path)
+    {
+        path /= std::filesystem::u8path(element);
+    }
+
+    return path.lexically_normal();
+}
+
+// Maps the files of every job onto the files on disk, files with the same path are only listed once
+static std::vector<DiskFile> planReads(std::vector<VerifyJob>& jobs)
+{
+    std::vector<DiskFile> diskFiles;
+    std::map<std::string, size_t> diskFileIndices;
+
+    for (VerifyJob& job : jobs)
+    {
+        if (!job.isValid)
+        {
+            continue;
+        }
+
+        uint64_t jobOffset = 0;
+        for (const TorrentFile& file : job.files)
+        {
+            if (file.length != 0)
+            {
+                std::string key = getFilePath(job, file).string();
+                auto [iterator, isNew] = diskFileIndices.try_emplace(key, diskFiles.size());
+                if (isNew)
+                {
+                    diskFiles.push_back({key, {}, 0});
+                }
+
+                DiskFile& diskFile = diskFiles[iterator->second];
+                diskFile.uses.push_back({&job, jobOffset, file.length});
+                diskFile.readLength = std::max(diskFile.readLength, file.length);
+            }
+
+            jobOffset += file.length;
+        }
+    }
+
+    return diskFiles;
+}
+
+// Merges the disk files which share all of their extents with another disk file, so their data is read only once
+// Files which are smaller than every piece which uses them are not checked, they don't contain whole pieces
+// Returns the number of merged files
+static size_t mergeSharedFiles(std::vector<DiskFile>& diskFiles)
+{
+    std::map<std::pair<uint64_t, std::vector<FileExtent>>, size_t> extentOwners;
+    std::vector<FileExtent> extents;
+
+    std::vector<DiskFile> uniqueFiles;
+    uniqueFiles.reserve(diskFiles.size());
+
+    for (DiskFile& diskFile : diskFiles)
+    {
+        uint64_t minPieceLength = UINT64_MAX;
+        for (const FileUse& use : diskFile.uses)
+        {
+            minPieceLength = std::min(minPieceLength, use.job->pieceLength);
+        }
+
+        std::error_code error;
+        uint64_t fileSize = std::filesystem::file_size(std::filesystem::u8path(diskFile.path), error);
+
+        if (!error && diskFile.readLength >= minPieceLength && getFileExtents(diskFile.path, extents))
+        {
+            auto [iterator, isNew] = extentOwners.try_emplace({fileSize, extents}, uniqueFiles.size());
+            if (!isNew)
+            {
+                DiskFile& owner = uniqueFiles[iterator->second];
+                owner.uses.insert(owner.uses.end(), diskFile.uses.begin(), diskFile.uses.end());
+                owner.readLength = std::max(owner.readLength, diskFile.readLength);
+                continue;
+            }
+        }
+
+        uniqueFiles.push_back(std::move(diskFile));
+    }
+
+    size_t mergedCount = diskFiles.size() - uniqueFiles.size();
+    diskFiles = std::move(uniqueFiles);
+    return mergedCount;
+}
+
+// The pieces of the torrent which are completely inside the file of the use
+static void getInnerPieces(const FileUse& use, uint64_t& firstPiece, uint64_t& pieceCount)
+{
+    const VerifyJob& job = *use.job;
+    uint64_t useEnd = use.jobOffset + use.length;
+
+    firstPiece = (use.jobOffset + job.pieceLength - 1) / job.pieceLength;
+    uint64_t endPiece = useEnd == job.totalLength ? job.getPieceCount() : useEnd / job.pieceLength;
+    pieceCount = endPiece > firstPiece ? endPiece - firstPiece : 0;
+}
+
+// Uses of the same data have the same inner pieces, if their pieces start at the same positions in the file
+static bool hasSameInnerPieces(const FileUse& a, const FileUse& b)
+{
+    const VerifyJob& jobA = *a.job;
+    const VerifyJob& jobB = *b.job;
+
+    // The last piece of a torrent can be shorter, it's only the same if both files are at the end of their torrents
+    bool isAtEndA = a.jobOffset + a.length == jobA.totalLength;
+    bool isAtEndB = b.jobOffset + b.length == jobB.totalLength;
+
+    return jobA.pieceLength == jobB.pieceLength && a.length == b.length &&
+           a.jobOffset % jobA.pieceLength == b.jobOffset % jobB.pieceLength && isAtEndA == isAtEndB;
+}
+
+// Passes the data at the given position of a disk file to a torrent which contains the file
+// Pieces inside the file are hashed with the hasher of the use (unless their hashes are reused from another use), the
+// data must be passed in order
+static void feedUse(const FileUse& use, UseHashing& hashing, uint64_t fileOffset, const uint8_t* data, size_t length)
+{
+    VerifyJob& job = *use.job;
+
+    if (fileOffset >= use.length)
+    {
+        return;
+    }
+
+    length = (size_t)std::min<uint64_t>(length, use.length - fileOffset);
+
+    uint64_t start = use.jobOffset + fileOffset;
+    uint64_t end = start + length;
+    uint64_t useEnd = use.jobOffset + use.length;
+
+    for (uint64_t pieceIndex = start / job.pieceLength; pieceIndex * job.pieceLength < end; ++pieceIndex)
+    {
+        uint64_t pieceStart = pieceIndex * job.pieceLength;
+        uint64_t pieceEnd = job.getPieceEnd(pieceIndex);
+
+        uint64_t partStart = std::max(start, pieceStart);
+        uint64_t partEnd = std::min(end, pieceEnd);
+        const uint8_t* part = data + (partStart - start);
+        size_t partLength = (size_t)(partEnd - partStart);
+
+        uint8_t hash[20];
+
+        if (pieceStart >= use.jobOffset && pieceEnd <= useEnd)
+        {
+            if (hashing.sourceUseIndex != -1)
+            {
+                continue;
+            }
+
+            hashing.hasher.update(part, partLength);
+
+            if (partEnd == pieceEnd)
+            {
+                hashing.hasher.finish(hash);
+                hashing.hasher.reset();
+                job.checkPiece(pieceIndex, hash);
+
+                if (!hashing.innerHashes.empty())
+                {
+                    memcpy(hashing.innerHashes.data() + hashing.innerHashCount * 20, hash, 20);
+                    ++hashing.innerHashCount;
+                }
+            }
+
+            continue;
+        }
+
+        std::lock_guard<std::mutex> lock(job.spanningPiecesMutex);
+
+        SpanningPiece& piece = job.spanningPieces[pieceIndex];
+        if (piece.isDeferred)
+        {
+            continue;
+        }
+
+        if (piece.data.empty())
+        {
+            uint64_t pieceSize = pieceEnd - pieceStart;
+            if (pendingSpanningSize.fetch_add(pieceSize) + pieceSize > maxPendingSpanningSize)
+            {
+                pendingSpanningSize -= pieceSize;
+                piece.isDeferred = true;
+                continue;
+            }
+
+            piece.data.resize((size_t)pieceSize);
+        }
+
+        memcpy(piece.data.data() + (partStart - pieceStart), part, partLength);
+        piece.receivedLength += partLength;
+
+        if (piece.receivedLength == piece.data.size())
+        {
+            hashMessage(piece.data.data(), piece.data.size(), hash);
+            job.checkPiece(pieceIndex, hash);
+            pendingSpanningSize -= piece.data.size();
+            job.spanningPieces.erase(pieceIndex);
+        }
+    }
+}
+
+// Reads the file once, and passes each chunk to every torrent which contains the file
+// Returns the number of bytes read
+static uint64_t readDiskFile(const DiskFile& diskFile, std::vector<uint8_t>& buffer)
+{
+    FILE* file = fopen(diskFile.path.c_str(), "rb");
+    if (file == nullptr)
+    {
+        return 0;
+    }
+
+    // The data is still read and hashed, so the other files of the pieces which span this file are checked as well
+    std::error_code error;
+    uint64_t diskSize = std::filesystem::file_size(std::filesystem::u8path(diskFile.path), error);
+    for (const FileUse& use : diskFile.uses)
+    {
+        if (error || diskSize != use.length)
+        {
+            std::lock_guard<std::mutex> lock(use.job->wrongSizeFilesMutex);
+            use.job->wrongSizeFiles.push_back({diskFile.path, use.jobOffset, use.length, error ? 0 : diskSize});
+        }
+    }
+
+    std::vector<UseHashing> hashings(diskFile.uses.size());
+    for (size_t i = 0; i < diskFile.uses.size(); ++i)
+    {
+        UseHashing& hashing = hashings[i];
+        getInnerPieces(diskFile.uses[i], hashing.firstInnerPiece, hashing.innerPieceCount);
+
+        for (size_t j = 0; j < i; ++j)
+        {
+            UseHashing& source = hashings[j];
+            if (source.sourceUseIndex == -1 && hasSameInnerPieces(diskFile.uses[j], diskFile.uses[i]))
+            {
+                hashing.sourceUseIndex = (int)j;
+                source.innerHashes.resize(source.innerPieceCount * 20);
+                break;
+            }
+        }
+    }
+
+    uint64_t fileOffset = 0;
+    while (fileOffset < diskFile.readLength)
+    {
+        size_t chunkLength = (size_t)std::min<uint64_t>(buffer.size(), diskFile.readLength - fileOffset);
+        size_t readLength = fread(buffer.data(), 1, chunkLength, file);
+
+        for (size_t i = 0; i < diskFile.uses.size(); ++i)
+        {
+            feedUse(diskFile.uses[i], hashings[i], fileOffset, buffer.data(), readLength);
+        }
+
+        fileOffset += readLength;
+
+        if (readLength != chunkLength)
+        {
+            // The file is shorter than expected, or it can't be read, the remaining pieces stay invalid
+            break;
+        }
+    }
+
+    fclose(file);
+
+    // Only the hashes of the pieces which were read completely are reused
+    for (size_t i = 0; i < diskFile.uses.size(); ++i)
+    {
+        const UseHashing& hashing = hashings[i];
+        if (hashing.sourceUseIndex == -1)
+        {
+            continue;
+        }
+
+        const UseHashing& source = hashings[hashing.sourceUseIndex];
+        for (uint64_t j = 0; j < source.innerHashCount; ++j)
+        {
+            diskFile.uses[i].job->checkPiece(hashing.firstInnerPiece + j, source.innerHashes.data() + j * 20);
+        }
+    }
+
+    return fileOffset;
+}
+
+// Reads a piece which spans multiple files from the files of the torrent, and checks it
+// Returns the number of bytes read
+static uint64_t verifyDeferredPiece(VerifyJob& job, uint64_t pieceIndex, std::vector<uint8_t>& buffer)
+{
+    uint64_t pieceStart = pieceIndex * job.pieceLength;
+    uint64_t pieceEnd = job.getPieceEnd(pieceIndex);
+    buffer.resize((size_t)(pieceEnd - pieceStart));
+
+    uint64_t bytesRead = 0;
+    uint64_t fileStart = 0;
+    for (const TorrentFile& file : job.files)
+    {
+        uint64_t fileEnd = fileStart + file.length;
+        uint64_t readStart = std::max(pieceStart, fileStart);
+        uint64_t readEnd = std::min(pieceEnd, fileEnd);
+
+        if (readStart < readEnd)
+        {
+            std::ifstream stream(getFilePath(job, file), std::ios::binary);
+            stream.seekg((std::streamoff)(readStart - fileStart));
+            stream.read((char*)buffer.data() + (readStart - pieceStart), (std::streamsize)(readEnd - readStart));
+
+            if (!stream)
+            {
+                // The file is missing or too short, the piece stays invalid
+                return bytesRead;
+            }
+
+            bytesRead += readEnd - readStart;
+        }
+
+        fileStart = fileEnd;
+    }
+
+    uint8_t hash[20];
+    hashMessage(buffer.data(), buffer.size(), hash);
+    job.checkPiece(pieceIndex, hash);
+    return bytesRead;
+}
+
+int main(int argc, char** argv)
+{
+    bool isProfiling = argc > 1 && std::string_view(argv[1]) == "--profile";
+    int argumentStart = isProfiling ? 2 : 1;
+    int argumentCount = argc - argumentStart;
+
+    if (argumentCount < 2 || argumentCount % 2 != 0)
+    {
+        std::cerr << "Usage: torrent_verify [--profile] <torrent file> <data path> [<torrent file> <data path> ...]"
+                  << std::endl;
+        return 1;
+    }
+
+    Profiler profiler(isProfiling);
+
+    Profiler::Stage loadStage(profiler, "load torrents");
+
+    // Not copyable or movable because of the mutex, so the jobs are created in place
+    std::vector<VerifyJob> jobs((size_t)argumentCount / 2);
+    for (size_t i = 0; i < jobs.size(); ++i)
+    {
+        VerifyJob& job = jobs[i];
+        job.torrentPath = argv[argumentStart + i * 2];
+        job.dataPath = std::filesystem::u8path(argv[argumentStart + 1 + i * 2]);
+        job.isValid = loadJob(job);
+    }
+
+    loadStage.end(0);
+
+    Profiler::Stage planStage(profiler, "plan reads");
+    std::vector<DiskFile> diskFiles = planReads(jobs);
+    planStage.end(0);
+
+    Profiler::Stage extentsStage(profiler, "find shared extents");
+    size_t sharedFileCount = mergeSharedFiles(diskFiles);
+    extentsStage.end(0);
+
+    selectBlocksFunction();
+
+    Profiler::Stage verifyStage(profiler, "read and hash");
+
+    auto startTime = std::chrono::steady_clock::now();
+
+    std::atomic<size_t> nextIndex{0};
+    std::atomic<uint64_t> totalBytesRead{0};
+
+    auto verifyFiles = [&]() {
+        std::vector<uint8_t> buffer(readChunkSize);
+        uint64_t bytesRead = 0;
+
+        for (size_t i = nextIndex++; i < diskFiles.size(); i = nextIndex++)
+        {
+            bytesRead += readDiskFile(diskFiles[i], buffer);
+        }
+
+        totalBytesRead += bytesRead;
+    };
+
+    unsigned int threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+    threadCount = (unsigned int)std::min<size_t>(threadCount, std::max<size_t>(diskFiles.size(), 1));
+
+    std::vector<std::thread> threads;
+    for (unsigned int i = 0; i < threadCount; ++i)
+    {
+        threads.emplace_back(verifyFiles);
+    }
+
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+
+    verifyStage.end(totalBytesRead);
+
+    // Only used when the spanning pieces didn't fit into the memory limit, so this is not parallel
+    Profiler::Stage deferredStage(profiler, "read deferred pieces");
+    uint64_t deferredBytesRead = 0;
+    std::vector<uint8_t> pieceBuffer;
+    for (VerifyJob& job : jobs)
+    {
+        for (const auto& [pieceIndex, piece] : job.spanningPieces)
+        {
+            if (piece.isDeferred)
+            {
+                deferredBytesRead += verifyDeferredPiece(job, pieceIndex, pieceBuffer);
+            }
+        }
+    }
+
+    deferredStage.end(deferredBytesRead);
+    totalBytesRead += deferredBytesRead;
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+    bool isEverythingValid = true;
+    uint64_t totalJobLength = 0;
+    for (VerifyJob& job : jobs)
+    {
+        job.invalidateWrongSizeFiles();
+        for (const WrongSizeFile& file : job.wrongSizeFiles)
+        {
+            std::cerr << "Wrong size: " << file.path << " is " << file.diskSize << " bytes instead of " << file.length
+                      << " (" << job.torrentPath << ")" << std::endl;
+        }
+
+        uint64_t pieceCount = job.isValid ? job.getPieceCount() : 0;
+        uint64_t validPieceCount = std::count(job.isPieceValid.begin(), job.isPieceValid.end(), 1);
+        bool isJobValid = job.isValid && validPieceCount == pieceCount;
+        isEverythingValid = isEverythingValid && isJobValid;
+        totalJobLength += job.isValid ? job.totalLength : 0;
+
+        const char* status = !job.isValid ? "INVALID" : isJobValid ? "OK" : "FAILED";
+        std::cout << status << " " << validPieceCount << "/" << pieceCount << " " << job.torrentPath << std::endl;
+    }
+
+    std::cerr << "Verified " << jobs.size() << " torrents, " << totalJobLength / 1e6 << " MB of torrent data, "
+              << totalBytesRead / 1e6 << " MB read from " << diskFiles.size() << " files (" << sharedFileCount
+              << " more files share their extents with these) in " << seconds << " s, "
+              << totalBytesRead / 1e6 / seconds << " MB/s, " << threadCount << " threads, sha-1 backend: "
+              << backendName << std::endl;
+
+    profiler.print(stderr);
+
+    return isEverythingValid ? 0 : 2;
+}
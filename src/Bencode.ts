@@ -52,7 +52,13 @@ type IBencodeString = string;
 type IBencodeBinaryString = Uint8Array;
 type IBencodeInt = number;
 
-type IBencodeObject = IBencodeDict | IBencodeList | IBencodeString | IBencodeBinaryString | IBencodeInt;
+type IBencodeObject =
+    | IBencodeDict
+    | IBencodeList
+    | IBencodeString
+    | IBencodeBinaryString
+    | IBencodeInt
+    | BencodeObject;
 
 export class BencodeBuffer {
     private bytesList: Uint8Array[] = [];
@@ -74,6 +80,16 @@ export class BencodeBuffer {
         return result;
     }
 
+    // The encoded data, in the order it was written, without copying it into a single buffer
+    // Binary strings (e.g. the pieces of a torrent) are not copied when they are written, so they are in this list
+    public getChunks(): readonly Uint8Array[] {
+        return this.bytesList;
+    }
+
+    public get chunkCount() {
+        return this.bytesList.length;
+    }
+
     public writeTextUTF8(text: string) {
         this.bytesList.push(new Uint8Array(toUTF8Bytes(text)));
     }
@@ -83,7 +99,7 @@ export class BencodeBuffer {
     }
 }
 
-abstract class BencodeObject {
+export abstract class BencodeObject {
     abstract encode(buffer: BencodeBuffer): BencodeBuffer;
 
     public getBencodeObject(obj: IBencodeObject): BencodeObject {
@@ -95,6 +111,10 @@ abstract class BencodeObject {
                 return new BencodeString(obj);
 
             case "object": {
+                if (obj instanceof BencodeObject) {
+                    return obj;
+                }
+
                 if (obj instanceof Uint8Array) {
                     return new BencodeBinaryString(obj);
                 }
@@ -131,18 +151,35 @@ export class BencodeDict extends BencodeObject {
     }
 
     public encode(buffer: BencodeBuffer) {
+        this.encodeWithValueRange(buffer, null);
+        return buffer;
+    }
+
+    // Same as encode, but also returns the range of chunks in the buffer, which contain the value of the given key
+    // (e.g. the info dictionary of a torrent, for calculating the info hash)
+    public encodeWithValueRange(buffer: BencodeBuffer, key: string | null) {
+        let startChunkIndex = 0;
+        let endChunkIndex = 0;
+
         buffer.writeTextUTF8("d");
 
         const sortedKeys = Object.keys(this.data).sort();
 
         for (const currentKey of sortedKeys) {
             new BencodeString(currentKey).encode(buffer);
-            this.data[currentKey].encode(buffer);
+
+            if (currentKey === key) {
+                startChunkIndex = buffer.chunkCount;
+                this.data[currentKey].encode(buffer);
+                endChunkIndex = buffer.chunkCount;
+            } else {
+                this.data[currentKey].encode(buffer);
+            }
         }
 
         buffer.writeTextUTF8("e");
 
-        return buffer;
+        return [startChunkIndex, endChunkIndex] as const;
     }
 }
 
@@ -217,3 +254,105 @@ export class BencodeInt extends BencodeObject {
         return buffer;
     }
 }
+
+// A value which is already encoded, e.g. a large file list (see encodeFileListEntries)
+// The chunks are written as they are
+export class BencodeEncoded extends BencodeObject {
+    public readonly chunks: readonly Uint8Array[];
+
+    constructor(chunks: readonly Uint8Array[]) {
+        super();
+        this.chunks = chunks;
+    }
+
+    public encode(buffer: BencodeBuffer) {
+        for (const chunk of this.chunks) {
+            buffer.writeBytes(chunk);
+        }
+
+        return buffer;
+    }
+}
+
+// Writes encoded values directly into a byte buffer, which grows as needed
+class BencodeByteWriter {
+    private bytes = new Uint8Array(64 * 1024);
+    private length = 0;
+
+    private reserve(count: number) {
+        if (this.length + count <= this.bytes.length) {
+            return;
+        }
+
+        const bytes = new Uint8Array(Math.max(this.bytes.length * 2, this.length + count));
+        bytes.set(this.bytes.subarray(0, this.length));
+        this.bytes = bytes;
+    }
+
+    // Only for ascii text (numbers and bencode tokens)
+    public writeAscii(text: string) {
+        this.reserve(text.length);
+        for (let i = 0; i < text.length; ++i) {
+            this.bytes[this.length++] = text.charCodeAt(i);
+        }
+    }
+
+    // Same as BencodeString.encode
+    public writeString(str: string) {
+        const byteCount = stringByteCountUTF8(str);
+        this.writeAscii(byteCount + ":");
+        this.reserve(byteCount);
+
+        const bytes = this.bytes;
+        let length = this.length;
+
+        // Same as toUTF8Bytes, without creating a temporary array
+        for (let i = 0; i < str.length; ++i) {
+            let charcode = str.charCodeAt(i);
+
+            if (charcode < 0x80) {
+                bytes[length++] = charcode;
+            } else if (charcode < 0x800) {
+                bytes[length++] = 0xc0 | (charcode >> 6);
+                bytes[length++] = 0x80 | (charcode & 0x3f);
+            } else if (charcode < 0xd800 || charcode >= 0xe000) {
+                bytes[length++] = 0xe0 | (charcode >> 12);
+                bytes[length++] = 0x80 | ((charcode >> 6) & 0x3f);
+                bytes[length++] = 0x80 | (charcode & 0x3f);
+            } else {
+                ++i;
+                charcode = 0x10000 + (((charcode & 0x3ff) << 10) | (str.charCodeAt(i) & 0x3ff));
+
+                bytes[length++] = 0xf0 | (charcode >> 18);
+                bytes[length++] = 0x80 | ((charcode >> 12) & 0x3f);
+                bytes[length++] = 0x80 | ((charcode >> 6) & 0x3f);
+                bytes[length++] = 0x80 | (charcode & 0x3f);
+            }
+        }
+
+        this.length = length;
+    }
+
+    // Copied into a buffer of the exact size, so it can be transferred without the unused capacity
+    public getBytes() {
+        return this.bytes.slice(0, this.length);
+    }
+}
+
+// Encodes the entries of a file list of a torrent, without the list tokens around them
+// The result is the same as encoding each entry with BencodeDict, but without creating objects for the entries
+export function encodeFileListEntries(files: readonly { length: number; path: readonly string[] }[]) {
+    const writer = new BencodeByteWriter();
+
+    for (const { length, path } of files) {
+        // The keys are in sorted order
+        writer.writeAscii("d6:lengthi" + length + "e4:pathl");
+        for (const element of path) {
+            writer.writeString(element);
+        }
+
+        writer.writeAscii("ee");
+    }
+
+    return writer.getBytes();
+}
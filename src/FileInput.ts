@@ -13,6 +13,11 @@ export interface FileWithPath {
     file: File;
 }
 
+export interface FileWithRelativePath {
+    relativePath: string; // Including the root folder and the file name, or empty for a single selected file
+    file: File;
+}
+
 export interface SelectedFileOrFolderInfo {
     name: string;
     size: number;
@@ -27,19 +32,26 @@ export interface SelectedFileOrFolderInfo {
           };
 
     fileList: FileWithPath[];
+
+    // Set if the files were read from an archive, instead of being selected directly
+    archiveName?: string;
+
+    // Identifies where the files are read from, if the relative paths of the files don't (e.g. the archive or the
+    // server), see PieceHashCache
+    sourceId?: string;
 }
 
-export function createFolderStructure(files: FileList) {
+export function createFolderStructure(files: Iterable<FileWithRelativePath>) {
     const rootFolder: FolderElement = {
         files: new Map(),
         folders: new Map(),
     };
 
-    for (const file of files) {
+    for (const { relativePath, file } of files) {
         let targetFolder = rootFolder;
 
-        if (file.webkitRelativePath !== "") {
-            const segments = file.webkitRelativePath.split("/");
+        if (relativePath !== "") {
+            const segments = relativePath.split("/");
 
             // First segment is the root folder, last segment is the file name
             for (let i = 1; i < segments.length - 1; ++i) {
@@ -70,7 +82,17 @@ export function loadFileOrFolder(files: FileList | null): SelectedFileOrFolderIn
         return null;
     }
 
-    const rootFolder = createFolderStructure(files);
+    return loadFileEntries(Array.from(files, file => ({ relativePath: file.webkitRelativePath, file })));
+}
+
+// The files are sorted by their paths, so the same files are in the same order in the torrent, regardless of whether
+// they were selected as a folder, read from an archive, or loaded from URLs (the order of these lists is not defined)
+export function loadFileEntries(entries: FileWithRelativePath[]): SelectedFileOrFolderInfo | null {
+    // Compared by UTF-16 code units, not by locale, so the order is the same on every computer
+    const sortedEntries = [...entries].sort((a, b) =>
+        a.relativePath < b.relativePath ? -1 : a.relativePath > b.relativePath ? 1 : 0,
+    );
+    const rootFolder = createFolderStructure(sortedEntries);
 
     function getFolderSize(folder: FolderElement) {
         let size = 0;
@@ -114,8 +136,6 @@ export function loadFileOrFolder(files: FileList | null): SelectedFileOrFolderIn
     } else {
         // Folder
 
-        let folderName: string | null = null;
-
         function visitFolder(folder: FolderElement, pathSegments: string[]) {
             for (const [childFolderName, childFolder] of folder.folders) {
                 pathSegments.push(childFolderName);
@@ -128,21 +148,18 @@ export function loadFileOrFolder(files: FileList | null): SelectedFileOrFolderIn
                     path: [...pathSegments, fileName],
                     file,
                 });
-
-                if (folderName === null) {
-                    const baseFolder = file.webkitRelativePath.split("/")[0];
-
-                    if (baseFolder.length !== 0) {
-                        folderName = baseFolder;
-                    }
-                }
             }
         }
 
         visitFolder(rootFolder, []);
 
-        if (folderName !== null) {
-            name = folderName;
+        for (const { relativePath } of entries) {
+            const baseFolder = relativePath.split("/")[0];
+
+            if (baseFolder.length !== 0) {
+                name = baseFolder;
+                break;
+            }
         }
 
         input = {
@@ -163,3 +180,54 @@ export function loadFileOrFolder(files: FileList | null): SelectedFileOrFolderIn
         fileList,
     };
 }
+
+export interface SubfolderInfo {
+    info: SelectedFileOrFolderInfo;
+    // Range of the files of the subfolder in the file list of the parent folder
+    firstFileIndex: number;
+    endFileIndex: number;
+}
+
+// Returns the first-level subfolders of the selected folder, which contain at least one non-empty file
+// The files of each subfolder are after each other in the file list, since child folders are visited first
+export function getSubfolders(selectedFileOrFolderInfo: SelectedFileOrFolderInfo): SubfolderInfo[] {
+    const { input, fileList } = selectedFileOrFolderInfo;
+    if (input.type !== InputType.Folder) {
+        return [];
+    }
+
+    const subfolders: SubfolderInfo[] = [];
+
+    let firstFileIndex = 0;
+    for (const [folderName, folder] of input.rootFolder.folders) {
+        let endFileIndex = firstFileIndex;
+        let size = 0;
+        while (endFileIndex < fileList.length && fileList[endFileIndex].path[0] === folderName) {
+            size += fileList[endFileIndex].file.size;
+            ++endFileIndex;
+        }
+
+        if (size !== 0) {
+            subfolders.push({
+                info: {
+                    name: folderName,
+                    size,
+                    input: {
+                        type: InputType.Folder,
+                        rootFolder: folder,
+                    },
+                    fileList: fileList.slice(firstFileIndex, endFileIndex).map(({ path, file }) => ({
+                        path: path.slice(1),
+                        file,
+                    })),
+                },
+                firstFileIndex,
+                endFileIndex,
+            });
+        }
+
+        firstFileIndex = endFileIndex;
+    }
+
+    return subfolders;
+}
@@ -0,0 +1,178 @@
+/**
+Watches a folder selected with the File System Access API, and reports the list of files when something changes
+
+Changes are detected with `FileSystemObserver` where it's available, otherwise the folder is scanned periodically
+A change is only reported once the folder has settled, i.e. two scans at least {@link settleIntervalMs} apart found
+the same files, with the same sizes and modification dates
+*/
+
+import type { FileWithRelativePath } from "./FileInput";
+
+const settleIntervalMs = 2000;
+
+// Used when change events are not available
+const pollIntervalMs = 10000;
+
+// These APIs are not available in every browser, and they are not in the type definitions yet
+interface DirectoryHandle {
+    kind: "directory";
+    name: string;
+    values: () => AsyncIterable<DirectoryHandle | FileHandle>;
+}
+
+interface FileHandle {
+    kind: "file";
+    name: string;
+    getFile: () => Promise<File>;
+}
+
+interface FileSystemObserverInstance {
+    observe: (handle: DirectoryHandle, options: { recursive: boolean }) => Promise<void>;
+    disconnect: () => void;
+}
+
+declare global {
+    interface Window {
+        showDirectoryPicker?: (options?: { mode?: "read" | "readwrite" }) => Promise<DirectoryHandle>;
+        FileSystemObserver?: new (callback: () => void) => FileSystemObserverInstance;
+    }
+}
+
+async function scanFolder(rootHandle: DirectoryHandle) {
+    const entries: FileWithRelativePath[] = [];
+
+    async function visitFolder(handle: DirectoryHandle, relativePath: string) {
+        for await (const child of handle.values()) {
+            const childPath = relativePath + "/" + child.name;
+
+            if (child.kind === "directory") {
+                await visitFolder(child, childPath);
+            } else {
+                entries.push({
+                    relativePath: childPath,
+                    file: await child.getFile(),
+                });
+            }
+        }
+    }
+
+    await visitFolder(rootHandle, rootHandle.name);
+    return entries;
+}
+
+function getFolderSignature(entries: FileWithRelativePath[]) {
+    return entries.map(({ relativePath, file }) => `${relativePath}:${file.size}:${file.lastModified}`).join("\n");
+}
+
+export class FolderWatcher {
+    private rootHandle: DirectoryHandle;
+    private onChange: (entries: FileWithRelativePath[]) => void;
+    private observer: FileSystemObserverInstance | null = null;
+
+    private scanTimeout: ReturnType<typeof setTimeout> | null = null;
+    private isScanning = false;
+    private isStopped = false;
+
+    private lastScanSignature: string | null = null;
+    private reportedSignature: string | null = null;
+
+    private constructor(rootHandle: DirectoryHandle, onChange: (entries: FileWithRelativePath[]) => void) {
+        this.rootHandle = rootHandle;
+        this.onChange = onChange;
+    }
+
+    public static isSupported() {
+        return typeof window.showDirectoryPicker === "function";
+    }
+
+    // Asks the user to select a folder, returns null if the selection was cancelled
+    public static async pick(onChange: (entries: FileWithRelativePath[]) => void) {
+        if (window.showDirectoryPicker === undefined) {
+            return null;
+        }
+
+        try {
+            const rootHandle = await window.showDirectoryPicker({ mode: "read" });
+            return new FolderWatcher(rootHandle, onChange);
+        } catch {
+            return null;
+        }
+    }
+
+    public async start() {
+        if (window.FileSystemObserver !== undefined) {
+            try {
+                const observer = new window.FileSystemObserver(() => this.scheduleScan(settleIntervalMs));
+                await observer.observe(this.rootHandle, { recursive: true });
+                this.observer = observer;
+            } catch {
+                // Fall back to polling
+            }
+        }
+
+        this.scheduleScan(0);
+    }
+
+    public stop() {
+        this.isStopped = true;
+        this.observer?.disconnect();
+
+        if (this.scanTimeout !== null) {
+            clearTimeout(this.scanTimeout);
+            this.scanTimeout = null;
+        }
+    }
+
+    private scheduleScan(delayMs: number) {
+        // If a scan is already scheduled, that scan will see the changes too
+        if (this.isStopped || this.scanTimeout !== null) {
+            return;
+        }
+
+        this.scanTimeout = setTimeout(() => {
+            this.scanTimeout = null;
+            this.scan();
+        }, delayMs);
+    }
+
+    private async scan() {
+        if (this.isScanning) {
+            this.scheduleScan(settleIntervalMs);
+            return;
+        }
+
+        this.isScanning = true;
+
+        let entries: FileWithRelativePath[] | null = null;
+        try {
+            entries = await scanFolder(this.rootHandle);
+        } catch {
+            // Files were probably moved or deleted during the scan, try again later
+        }
+
+        this.isScanning = false;
+
+        if (this.isStopped) {
+            return;
+        }
+
+        const signature = entries === null ? null : getFolderSignature(entries);
+
+        if (entries !== null && (this.reportedSignature === null || signature === this.lastScanSignature)) {
+            // The initial state is reported immediately, later changes only when they are settled
+            if (signature !== this.reportedSignature) {
+                this.reportedSignature = signature;
+                this.onChange(entries);
+            }
+        } else {
+            // Still changing, check again later
+            this.scheduleScan(settleIntervalMs);
+        }
+
+        this.lastScanSignature = signature;
+
+        if (this.observer === null) {
+            this.scheduleScan(pollIntervalMs);
+        }
+    }
+}
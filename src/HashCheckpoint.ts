@@ -0,0 +1,262 @@
+/**
+Periodically saves the completed piece hashes of a hashing run, so an interrupted run (e.g. closed tab, crash, reboot)
+can be continued later, instead of starting over
+
+A checkpoint is only used with the same piece size, and only for the pieces which are fully contained in
+the first files of the list that have the same paths, sizes and modification dates as before
+*/
+
+import type { FileWithPath } from "./FileInput";
+import { openDatabase, requestToPromise, StoreName, transactionToPromise } from "./Storage";
+
+// At most this much work is lost when a run is interrupted
+const checkpointIntervalMs = 5000;
+
+const checkpointFormatVersion = 1;
+
+interface StoredCheckpoint {
+    signature: Uint8Array;
+    pieceCount: number;
+}
+
+// Compact binary description of the job, used to validate a stored checkpoint
+function createJobSignature(fileList: FileWithPath[], blockSize: number) {
+    const textEncoder = new TextEncoder();
+    const encodedPaths = fileList.map(({ path }) => textEncoder.encode(path.join("/")));
+
+    let totalSize = 16;
+    for (const encodedPath of encodedPaths) {
+        totalSize += 20 + encodedPath.length;
+    }
+
+    const signature = new Uint8Array(totalSize);
+    const view = new DataView(signature.buffer);
+
+    view.setUint32(0, checkpointFormatVersion, true);
+    view.setFloat64(4, blockSize, true);
+    view.setUint32(12, fileList.length, true);
+
+    let offset = 16;
+    for (let i = 0; i < fileList.length; ++i) {
+        const { file } = fileList[i];
+        const encodedPath = encodedPaths[i];
+
+        view.setFloat64(offset, file.size, true);
+        view.setFloat64(offset + 8, file.lastModified, true);
+        view.setUint32(offset + 16, encodedPath.length, true);
+        signature.set(encodedPath, offset + 20);
+
+        offset += 20 + encodedPath.length;
+    }
+
+    return signature;
+}
+
+// Returns the number of bytes at the start of the job, where the files are the same in both signatures
+function getMatchingByteCount(storedSignature: Uint8Array, signature: Uint8Array) {
+    const storedView = new DataView(storedSignature.buffer, storedSignature.byteOffset, storedSignature.byteLength);
+    const view = new DataView(signature.buffer, signature.byteOffset, signature.byteLength);
+
+    if (
+        storedSignature.length < 16 ||
+        storedView.getUint32(0, true) !== view.getUint32(0, true) ||
+        storedView.getFloat64(4, true) !== view.getFloat64(4, true)
+    ) {
+        return 0;
+    }
+
+    let matchingByteCount = 0;
+    let offset = 16;
+    while (offset + 20 <= storedSignature.length && offset + 20 <= signature.length) {
+        const entryLength = 20 + view.getUint32(offset + 16, true);
+        if (offset + entryLength > storedSignature.length) {
+            break;
+        }
+
+        for (let i = offset; i < offset + entryLength; ++i) {
+            if (storedSignature[i] !== signature[i]) {
+                return matchingByteCount;
+            }
+        }
+
+        matchingByteCount += view.getFloat64(offset, true);
+        offset += entryLength;
+    }
+
+    // If all files are the same, then the last piece (which might be shorter than the others) can be used too
+    return offset === storedSignature.length && offset === signature.length ? Infinity : matchingByteCount;
+}
+
+function getJobKey(fileList: FileWithPath[], blockSize: number) {
+    // Only one checkpoint is kept for similar jobs, the signature decides which part of it can be used
+    const firstPath = fileList.length === 0 ? "" : fileList[0].path.join("/");
+    return `${blockSize}:${firstPath}`;
+}
+
+export class HashCheckpoint {
+    private db: IDBDatabase | null;
+    private jobKey: string;
+    private signature: Uint8Array;
+
+    // Piece hashes which were restored from the stored checkpoint
+    public readonly resumePieces: Uint8Array;
+
+    private pieces: Uint8Array | null = null;
+    private completedRanges = new Map<number, number>(); // Start piece index -> piece count
+    private completedPieceCount: number;
+    private savedPieceCount: number;
+
+    private lastSaveTime = performance.now();
+    private pendingSave: Promise<void> = Promise.resolve();
+
+    private constructor(db: IDBDatabase | null, jobKey: string, signature: Uint8Array, resumePieces: Uint8Array) {
+        this.db = db;
+        this.jobKey = jobKey;
+        this.signature = signature;
+        this.resumePieces = resumePieces;
+        this.completedPieceCount = resumePieces.length / 20;
+        this.savedPieceCount = 0;
+    }
+
+    public get resumePieceCount() {
+        return this.resumePieces.length / 20;
+    }
+
+    public static async load(fileList: FileWithPath[], blockSize: number) {
+        const db = await openDatabase();
+        const jobKey = getJobKey(fileList, blockSize);
+        const signature = createJobSignature(fileList, blockSize);
+
+        let resumePieces = new Uint8Array();
+
+        if (db !== null) {
+            try {
+                resumePieces = await HashCheckpoint.loadPieces(db, jobKey, signature, blockSize);
+            } catch {
+                // Start from the beginning
+            }
+        }
+
+        return new HashCheckpoint(db, jobKey, signature, resumePieces);
+    }
+
+    private static async loadPieces(db: IDBDatabase, jobKey: string, signature: Uint8Array, blockSize: number) {
+        const transaction = db.transaction([StoreName.Checkpoints, StoreName.CheckpointPieces], "readonly");
+
+        const stored: StoredCheckpoint | undefined = await requestToPromise(
+            transaction.objectStore(StoreName.Checkpoints).get(jobKey),
+        );
+
+        if (stored === undefined) {
+            return new Uint8Array();
+        }
+
+        const matchingByteCount = getMatchingByteCount(stored.signature, signature);
+        const validPieceCount = Math.min(stored.pieceCount, Math.floor(matchingByteCount / blockSize));
+        if (validPieceCount === 0) {
+            return new Uint8Array();
+        }
+
+        const chunks: Uint8Array[] = await requestToPromise(
+            transaction.objectStore(StoreName.CheckpointPieces).getAll(getPiecesKeyRange(jobKey)),
+        );
+
+        // Chunks are sorted by their start piece index, and they follow each other without gaps
+        const pieces = new Uint8Array(validPieceCount * 20);
+        let offset = 0;
+        for (const chunk of chunks) {
+            if (offset >= pieces.length) {
+                break;
+            }
+
+            const usedChunk = chunk.subarray(0, pieces.length - offset);
+            pieces.set(usedChunk, offset);
+            offset += usedChunk.length;
+        }
+
+        return pieces.subarray(0, offset);
+    }
+
+    // Should be called when hashing starts, with the array that will contain all piece hashes
+    public start(pieces: Uint8Array) {
+        this.pieces = pieces;
+
+        // The stored checkpoint might contain pieces that are no longer valid, and the previous job might have
+        // been a different one with the same key, so it's replaced with the usable pieces
+        this.deleteStoredCheckpoint();
+        this.save();
+    }
+
+    // Should be called when the hashes of the given pieces are written into the pieces array
+    public onPiecesCompleted(startPieceIndex: number, pieceCount: number) {
+        this.completedRanges.set(startPieceIndex, pieceCount);
+
+        // Only the pieces from the beginning without gaps can be saved, since reading can be continued from there
+        let count: number | undefined;
+        while ((count = this.completedRanges.get(this.completedPieceCount)) !== undefined) {
+            this.completedRanges.delete(this.completedPieceCount);
+            this.completedPieceCount += count;
+        }
+
+        if (performance.now() - this.lastSaveTime >= checkpointIntervalMs) {
+            this.save();
+        }
+    }
+
+    // Removes the checkpoint, should be called when the run has completed
+    public async finish() {
+        this.deleteStoredCheckpoint();
+        await this.pendingSave;
+    }
+
+    // Saves the pieces which were completed since the last save
+    // This is called periodically, but it should also be called when the run is stopped before completion
+    public save() {
+        this.lastSaveTime = performance.now();
+
+        const startPieceIndex = this.savedPieceCount;
+        const endPieceIndex = this.completedPieceCount;
+        if (this.pieces === null || endPieceIndex === startPieceIndex) {
+            return;
+        }
+
+        this.savedPieceCount = endPieceIndex;
+
+        // Only the new pieces are written, as a separate chunk
+        const chunk = this.pieces.slice(startPieceIndex * 20, endPieceIndex * 20);
+        const storedCheckpoint: StoredCheckpoint = {
+            signature: this.signature,
+            pieceCount: endPieceIndex,
+        };
+
+        this.enqueueSave(async db => {
+            const transaction = db.transaction([StoreName.Checkpoints, StoreName.CheckpointPieces], "readwrite");
+            transaction.objectStore(StoreName.CheckpointPieces).put(chunk, [this.jobKey, startPieceIndex]);
+            transaction.objectStore(StoreName.Checkpoints).put(storedCheckpoint, this.jobKey);
+            await transactionToPromise(transaction);
+        });
+    }
+
+    private deleteStoredCheckpoint() {
+        this.enqueueSave(async db => {
+            const transaction = db.transaction([StoreName.Checkpoints, StoreName.CheckpointPieces], "readwrite");
+            transaction.objectStore(StoreName.Checkpoints).delete(this.jobKey);
+            transaction.objectStore(StoreName.CheckpointPieces).delete(getPiecesKeyRange(this.jobKey));
+            await transactionToPromise(transaction);
+        });
+    }
+
+    private enqueueSave(callback: (db: IDBDatabase) => Promise<void>) {
+        const db = this.db;
+        if (db === null) {
+            return;
+        }
+
+        // Saves are done in order, and a failed save doesn't stop the hashing
+        this.pendingSave = this.pendingSave.then(() => callback(db)).catch(() => {});
+    }
+}
+
+function getPiecesKeyRange(jobKey: string) {
+    return IDBKeyRange.bound([jobKey, 0], [jobKey, Infinity]);
+}
@@ -0,0 +1,137 @@
+/**
+Statistics of a hashing run, which can be exported as a JSON summary, or in the Prometheus text format
+*/
+
+export interface HashingMetricsSummary {
+    kernel: string;
+    workerCount: number;
+    fileCount: number;
+    totalBytes: number;
+    bytesRead: number;
+    bytesHashed: number;
+    piecesHashed: number;
+    cacheHitPieces: number;
+    cacheHitBytes: number;
+    resumedBytes: number;
+    zeroPieces: number;
+    readWaitSeconds: number;
+    workerWaitSeconds: number;
+    maxPendingBatches: number;
+    maxWorkerQueueDepth: number;
+    durationSeconds: number;
+    throughputBytesPerSecond: number;
+}
+
+export class HashingMetrics {
+    public kernel = "unknown";
+    public workerCount = 0;
+
+    public readonly fileCount: number;
+    public readonly totalBytes: number;
+
+    public bytesRead = 0;
+    public bytesHashed = 0;
+    public piecesHashed = 0;
+    public cacheHitPieces = 0;
+    public cacheHitBytes = 0;
+    public resumedBytes = 0;
+    // Pieces which contain only zero bytes, if they were checked (see HashingOptions.zeroPieceIndices)
+    public zeroPieces = 0;
+
+    // Time spent waiting for the data to be read from the disk
+    public readWaitMs = 0;
+    // Time spent by batches waiting for a free worker
+    public workerWaitMs = 0;
+
+    // Batches which were dispatched, but their hashes are not calculated yet
+    private pendingBatches = 0;
+    public maxPendingBatches = 0;
+    public maxWorkerQueueDepth = 0;
+
+    private startTime = performance.now();
+    private endTime: number | null = null;
+
+    constructor(fileCount: number, totalBytes: number) {
+        this.fileCount = fileCount;
+        this.totalBytes = totalBytes;
+    }
+
+    public onBatchDispatched() {
+        ++this.pendingBatches;
+        this.maxPendingBatches = Math.max(this.maxPendingBatches, this.pendingBatches);
+    }
+
+    public onBatchCompleted(pieceCount: number, byteCount: number) {
+        --this.pendingBatches;
+        this.piecesHashed += pieceCount;
+        this.bytesHashed += byteCount;
+    }
+
+    public onWorkerQueued(queueDepth: number) {
+        this.maxWorkerQueueDepth = Math.max(this.maxWorkerQueueDepth, queueDepth);
+    }
+
+    public finish() {
+        this.endTime = performance.now();
+    }
+
+    public getSummary(): HashingMetricsSummary {
+        const durationSeconds = ((this.endTime ?? performance.now()) - this.startTime) / 1000;
+
+        return {
+            kernel: this.kernel,
+            workerCount: this.workerCount,
+            fileCount: this.fileCount,
+            totalBytes: this.totalBytes,
+            bytesRead: this.bytesRead,
+            bytesHashed: this.bytesHashed,
+            piecesHashed: this.piecesHashed,
+            cacheHitPieces: this.cacheHitPieces,
+            cacheHitBytes: this.cacheHitBytes,
+            resumedBytes: this.resumedBytes,
+            zeroPieces: this.zeroPieces,
+            readWaitSeconds: this.readWaitMs / 1000,
+            workerWaitSeconds: this.workerWaitMs / 1000,
+            maxPendingBatches: this.maxPendingBatches,
+            maxWorkerQueueDepth: this.maxWorkerQueueDepth,
+            durationSeconds,
+            throughputBytesPerSecond: durationSeconds === 0 ? 0 : this.bytesRead / durationSeconds,
+        };
+    }
+
+    public toJSON() {
+        return JSON.stringify(this.getSummary(), null, 4);
+    }
+
+    // https://prometheus.io/docs/instrumenting/exposition_formats/#text-based-format
+    public toPrometheusText() {
+        const summary = this.getSummary();
+        const labels = `{kernel="${summary.kernel}"}`;
+
+        const lines: string[] = [];
+        function addMetric(name: string, type: "counter" | "gauge", help: string, value: number) {
+            lines.push(`# HELP torrent_creator_${name} ${help}`);
+            lines.push(`# TYPE torrent_creator_${name} ${type}`);
+            lines.push(`torrent_creator_${name}${labels} ${value}`);
+        }
+
+        addMetric("workers", "gauge", "Number of hashing workers.", summary.workerCount);
+        addMetric("files", "gauge", "Number of input files.", summary.fileCount);
+        addMetric("input_bytes", "gauge", "Total size of the input files.", summary.totalBytes);
+        addMetric("read_bytes_total", "counter", "Bytes read from the input files.", summary.bytesRead);
+        addMetric("hashed_bytes_total", "counter", "Bytes hashed by the workers.", summary.bytesHashed);
+        addMetric("hashed_pieces_total", "counter", "Pieces hashed by the workers.", summary.piecesHashed);
+        addMetric("cache_hit_pieces_total", "counter", "Pieces reused from the piece cache.", summary.cacheHitPieces);
+        addMetric("cache_hit_bytes_total", "counter", "Bytes skipped due to the piece cache.", summary.cacheHitBytes);
+        addMetric("resumed_bytes_total", "counter", "Bytes not read because of a checkpoint.", summary.resumedBytes);
+        addMetric("zero_pieces_total", "counter", "Hashed pieces with only zero bytes.", summary.zeroPieces);
+        addMetric("read_wait_seconds_total", "counter", "Time spent waiting for reads.", summary.readWaitSeconds);
+        addMetric("worker_wait_seconds_total", "counter", "Time spent waiting for workers.", summary.workerWaitSeconds);
+        addMetric("max_pending_batches", "gauge", "Most batches being hashed at once.", summary.maxPendingBatches);
+        addMetric("max_worker_queue_depth", "gauge", "Most batches waiting for a worker.", summary.maxWorkerQueueDepth);
+        addMetric("duration_seconds", "gauge", "Duration of the run.", summary.durationSeconds);
+        addMetric("throughput_bytes_per_second", "gauge", "Read throughput.", summary.throughputBytesPerSecond);
+
+        return lines.join("\n") + "\n";
+    }
+}
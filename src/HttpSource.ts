@@ -0,0 +1,194 @@
+/**
+Files served over HTTP, which can be hashed without downloading them to the disk first
+
+Each file is read with `Range` requests, which are sent ahead of the reads with multiple connections, so the throughput
+scales with the number of connections
+The files only implement the parts of the `File` interface which are used for hashing (size, slice, and stream)
+Reading them requires byte stream support, which is available in every browser that supports BYOB readers
+*/
+
+import type { FileWithRelativePath } from "./FileInput";
+import { MB, Result } from "./Util";
+
+// Size of each request, which is a multiple of the piece size for pieces up to 4MB
+// Requests are aligned to this size in the file, so in single-file torrents they are also aligned to the pieces
+const rangeSize = 4 * MB;
+
+export const defaultConnectionCount = 8;
+
+class HttpFile {
+    public readonly name: string;
+    public readonly lastModified: number;
+    public readonly webkitRelativePath = "";
+
+    private readonly url: string;
+    private readonly start: number;
+    private readonly end: number;
+    private readonly connectionCount: number;
+
+    constructor(url: string, name: string, lastModified: number, start: number, end: number, connectionCount: number) {
+        this.url = url;
+        this.name = name;
+        this.lastModified = lastModified;
+        this.start = start;
+        this.end = end;
+        this.connectionCount = connectionCount;
+    }
+
+    public get size() {
+        return this.end - this.start;
+    }
+
+    // Same as Blob.slice, without negative indices
+    public slice(start = 0, end = this.size) {
+        start = Math.min(start, this.size);
+        end = Math.min(Math.max(end, start), this.size);
+
+        const { url, name, lastModified, connectionCount } = this;
+        return new HttpFile(url, name, lastModified, this.start + start, this.start + end, connectionCount);
+    }
+
+    private async fetchRange(start: number, end: number, signal: AbortSignal) {
+        const response = await fetch(this.url, {
+            headers: { Range: `bytes=${start}-${end - 1}` },
+            signal,
+        });
+
+        if (response.status !== 206) {
+            throw Error(`Range requests are not supported: ${this.url}`);
+        }
+
+        const data = new Uint8Array(await response.arrayBuffer());
+        if (data.length !== end - start) {
+            throw Error(`Unexpected response length: ${this.url}`);
+        }
+
+        return data;
+    }
+
+    public stream() {
+        const abortController = new AbortController();
+        const pendingRanges: Promise<Uint8Array>[] = [];
+        let nextRangeStart = this.start;
+
+        // Keeps a request in flight on each connection
+        const requestRanges = () => {
+            while (pendingRanges.length < this.connectionCount && nextRangeStart < this.end) {
+                const rangeEnd = Math.min((Math.floor(nextRangeStart / rangeSize) + 1) * rangeSize, this.end);
+                const range = this.fetchRange(nextRangeStart, rangeEnd, abortController.signal);
+
+                // Errors are reported when the range is read
+                range.catch(() => {});
+
+                pendingRanges.push(range);
+                nextRangeStart = rangeEnd;
+            }
+        };
+
+        return new ReadableStream({
+            type: "bytes",
+            pull: async controller => {
+                requestRanges();
+
+                const range = pendingRanges.shift();
+                if (range === undefined) {
+                    controller.close();
+                    controller.byobRequest?.respond(0);
+                    return;
+                }
+
+                controller.enqueue(await range);
+                requestRanges();
+            },
+            cancel: () => abortController.abort(),
+        });
+    }
+}
+
+export interface HttpFileEntries {
+    entries: FileWithRelativePath[];
+    // Web seed which serves the same files, see BEP 19
+    webSeed: string | null;
+    // The server and the common folder of the files, the paths of the entries are relative to this folder
+    sourceId: string;
+}
+
+// Creates the file entries for the given URLs
+// A single URL is a single file, multiple URLs are a folder, which contains the files relative to their common folder
+export async function loadHttpFiles(
+    urls: string[],
+    connectionCount = defaultConnectionCount,
+): Promise<Result<HttpFileEntries, string>> {
+    const parsedUrls: URL[] = [];
+    for (const url of urls) {
+        try {
+            parsedUrls.push(new URL(url));
+        } catch {
+            return Result.error(`Invalid URL: \`${url}\``);
+        }
+    }
+
+    if (parsedUrls.length === 0) {
+        return Result.error("No URLs were given");
+    }
+
+    if (parsedUrls.some(url => url.origin !== parsedUrls[0].origin)) {
+        return Result.error("All URLs must be on the same server");
+    }
+
+    const urlPaths = parsedUrls.map(url => url.pathname.split("/").slice(1).map(decodeURIComponent));
+
+    // Common folder of all files
+    let commonFolderLength = parsedUrls.length === 1 ? urlPaths[0].length - 1 : 0;
+    const isFolderShared = (folderIndex: number) =>
+        urlPaths.every(path => path.length - 1 > folderIndex && path[folderIndex] === urlPaths[0][folderIndex]);
+
+    while (isFolderShared(commonFolderLength)) {
+        ++commonFolderLength;
+    }
+
+    const rootFolderName = commonFolderLength === 0 ? parsedUrls[0].hostname : urlPaths[0][commonFolderLength - 1];
+
+    const entries: FileWithRelativePath[] = [];
+    try {
+        await Promise.all(
+            parsedUrls.map(async (url, i) => {
+                const response = await fetch(url, { method: "HEAD" });
+                const contentLength = response.headers.get("Content-Length");
+
+                if (!response.ok || contentLength === null) {
+                    throw Error(`Cannot get the size of \`${url}\``);
+                }
+
+                const lastModifiedHeader = response.headers.get("Last-Modified");
+                const lastModified = lastModifiedHeader === null ? 0 : Date.parse(lastModifiedHeader) || 0;
+
+                const path = urlPaths[i];
+                const name = path[path.length - 1];
+                const size = parseInt(contentLength, 10);
+
+                const relativePath = [rootFolderName, ...path.slice(commonFolderLength)].join("/");
+
+                entries[i] = {
+                    relativePath: parsedUrls.length === 1 ? "" : relativePath,
+                    file: new HttpFile(url.href, name, lastModified, 0, size, connectionCount) as unknown as File,
+                };
+            }),
+        );
+    } catch (ex) {
+        return Result.error(ex instanceof Error ? ex.message : String(ex));
+    }
+
+    // Clients append the torrent name and the file path to the web seed of multi-file torrents
+    let webSeed: string | null = null;
+    if (parsedUrls.length === 1) {
+        webSeed = parsedUrls[0].href;
+    } else if (commonFolderLength !== 0) {
+        const parentFolderPath = parsedUrls[0].pathname.split("/").slice(0, commonFolderLength).join("/");
+        webSeed = parsedUrls[0].origin + parentFolderPath + "/";
+    }
+
+    const sourceId = [parsedUrls[0].origin, ...urlPaths[0].slice(0, commonFolderLength)].join("/");
+
+    return Result.ok({ entries, webSeed, sourceId });
+}
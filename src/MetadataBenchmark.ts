@@ -0,0 +1,182 @@
+/**
+Benchmarks the metadata path of torrent creation, which dominates jobs with many small files:
+building the folder model from the selected files, assembling and bencoding the torrent, and calculating the info hash
+
+The file lists are synthetic, with deep paths and Unicode names, and they are generated with a fixed seed, so the
+results of different runs can be compared
+The results are shown on the page, and can be downloaded as JSON for tracking them over time
+*/
+
+import { BencodeBuffer, BencodeDict } from "./Bencode";
+import { loadFileEntries, type FileWithRelativePath } from "./FileInput";
+import { createTorrentModel } from "./ParallelEncoding";
+import { assembleTorrentObject, calculateInfoHash } from "./TorrentObject";
+import { BlockSize, type TorrentUIParameters } from "./UIState";
+import { MB } from "./Util";
+
+const defaultFileCounts = [1_000, 10_000, 100_000, 1_000_000, 2_000_000];
+
+const maxPathDepth = 12;
+
+// Mix of ASCII, 2, 3, and 4-byte UTF-8 characters
+const nameParts = ["season", "épisode", "データ", "файл", "音楽", "🎬", "backup", "ünïcödé", "日本語", "x"];
+
+const torrentUIParameters: TorrentUIParameters = {
+    name: "benchmark",
+    blockSize: BlockSize.MB16,
+    isPrivate: false,
+    setCreationDate: false,
+    trackers: "",
+    webSeeds: "",
+    comment: "",
+    source: "",
+    variants: "",
+    createSubfolderTorrents: false,
+    detectZeroPieces: false,
+};
+
+export interface MetadataBenchmarkResult {
+    fileCount: number;
+    totalSize: number;
+    folderModelMs: number;
+    assembleMs: number;
+    bencodeModelMs: number;
+    encodeMs: number;
+    getBytesMs: number;
+    // Model and encoding with the file list encoded by encodeFileListEntries (see createTorrentModel)
+    fileListEncodeMs: number;
+    infoHashMs: number;
+    torrentBytes: number;
+    // Largest JS heap size measured after the steps, only available in Chromium based browsers
+    // The heap is not sampled during the steps, so this is not the peak, the temporary memory of a step is missed
+    maxHeapAfterStepBytes: number | null;
+}
+
+// Deterministic pseudo-random numbers (mulberry32)
+function createRandom(seed: number) {
+    return () => {
+        seed = (seed + 0x6d2b79f5) | 0;
+        let t = Math.imul(seed ^ (seed >>> 15), seed | 1);
+        t ^= t + Math.imul(t ^ (t >>> 7), t | 61);
+        return ((t ^ (t >>> 14)) >>> 0) / 4294967296;
+    };
+}
+
+// Only the properties which are used for the metadata are needed, the contents are never read
+function createFileEntries(fileCount: number): FileWithRelativePath[] {
+    const random = createRandom(fileCount);
+    const randomName = () => nameParts[Math.floor(random() * nameParts.length)] + Math.floor(random() * 1000);
+
+    const entries: FileWithRelativePath[] = [];
+
+    // Files are grouped into folders, like in real folder structures
+    let folderPath = "benchmark";
+    for (let i = 0; i < fileCount; ++i) {
+        if (i % 50 === 0) {
+            const depth = 1 + Math.floor(random() * maxPathDepth);
+            folderPath = "benchmark";
+            for (let j = 0; j < depth; ++j) {
+                folderPath += "/" + randomName();
+            }
+        }
+
+        const name = `${randomName()}-${i}.bin`;
+        const file = { name, size: Math.floor(random() * 4 * MB), lastModified: 0 } as File;
+
+        entries.push({
+            relativePath: `${folderPath}/${name}`,
+            file,
+        });
+    }
+
+    return entries;
+}
+
+function getHeapSize(): number | null {
+    const memory = (performance as Performance & { memory?: { usedJSHeapSize: number } }).memory;
+    return memory === undefined ? null : memory.usedJSHeapSize;
+}
+
+export async function runMetadataBenchmark(fileCount: number): Promise<MetadataBenchmarkResult> {
+    let maxHeapAfterStepBytes = getHeapSize();
+    const sampleHeap = () => {
+        const heapSize = getHeapSize();
+        if (heapSize !== null && maxHeapAfterStepBytes !== null) {
+            maxHeapAfterStepBytes = Math.max(maxHeapAfterStepBytes, heapSize);
+        }
+    };
+
+    const measure = <T>(callback: () => T): [T, number] => {
+        const startTime = performance.now();
+        const result = callback();
+        const duration = performance.now() - startTime;
+
+        sampleHeap();
+        return [result, duration];
+    };
+
+    const entries = createFileEntries(fileCount);
+
+    const [info, folderModelMs] = measure(() => loadFileEntries(entries));
+    if (info === null) {
+        throw Error("No files were generated");
+    }
+
+    const blockSize = 16 * MB;
+    const [torrentObject, assembleMs] = measure(() =>
+        assembleTorrentObject(torrentUIParameters, info, blockSize).getResult(),
+    );
+    if (torrentObject === null) {
+        throw Error("Cannot assemble the torrent");
+    }
+
+    torrentObject.info.pieces = new Uint8Array(Math.ceil(info.size / blockSize) * 20);
+
+    const [bencodeDict, bencodeModelMs] = measure(() => new BencodeDict(torrentObject));
+    const [buffer, encodeMs] = measure(() => bencodeDict.encode(new BencodeBuffer()));
+    const [bytes, getBytesMs] = measure(() => buffer.getBytes());
+
+    const [, fileListEncodeMs] = measure(() => createTorrentModel(torrentObject).encode(new BencodeBuffer()));
+    sampleHeap();
+
+    const infoHashStartTime = performance.now();
+    await calculateInfoHash(torrentObject.info);
+    const infoHashMs = performance.now() - infoHashStartTime;
+    sampleHeap();
+
+    return {
+        fileCount,
+        totalSize: info.size,
+        folderModelMs,
+        assembleMs,
+        bencodeModelMs,
+        encodeMs,
+        getBytesMs,
+        fileListEncodeMs,
+        infoHashMs,
+        torrentBytes: bytes.length,
+        maxHeapAfterStepBytes,
+    };
+}
+
+// Runs the benchmark for each file count, the file counts can be set with the `fileCounts` query parameter
+// (e.g. bench.html?fileCounts=1000,10000)
+export async function runMetadataBenchmarks(onResult: (result: MetadataBenchmarkResult) => void) {
+    const fileCountsParameter = new URLSearchParams(location.search).get("fileCounts");
+    const fileCounts =
+        fileCountsParameter === null ? defaultFileCounts : fileCountsParameter.split(",").map(Number);
+
+    const results: MetadataBenchmarkResult[] = [];
+    for (const fileCount of fileCounts) {
+        const result = await runMetadataBenchmark(fileCount);
+        results.push(result);
+        onResult(result);
+    }
+
+    return {
+        date: new Date().toISOString(),
+        userAgent: navigator.userAgent,
+        hardwareConcurrency: navigator.hardwareConcurrency,
+        results,
+    };
+}
@@ -0,0 +1,101 @@
+/**
+Encodes the file lists of torrents with many files
+
+After the pieces, the file list is the largest part of a torrent with many files, and encoding it with BencodeDict
+objects takes a long time. Instead, the entries are written directly into byte buffers (see
+{@link encodeFileListEntries}), in ranges of {@link rangeFileCount} files
+This is done on the main thread: sending the entries to the workers would take about half as long as encoding them,
+because the path arrays are cloned for the message, so the workers would save little of the time of the main thread
+The info hash is calculated on a worker from the encoded parts in order, each range is hashed as soon as it's encoded
+*/
+
+import { BencodeBuffer, BencodeDict, BencodeEncoded, encodeFileListEntries } from "./Bencode";
+import { calculatePartsHash, getOutputParts } from "./TorrentFileOutput";
+import type { TorrentFileInfo, TorrentInfo, TorrentObject } from "./TorrentObject";
+
+// Smaller file lists are encoded with BencodeDict objects, and their info hash is calculated in one part
+export const minParallelFileCount = 10000;
+
+// Number of files in each encoded part of the file list
+const rangeFileCount = 5000;
+
+const listStart = new Uint8Array([0x6c]); // "l"
+const listEnd = new Uint8Array([0x65]); // "e"
+
+// Encoded file lists, so a file list is encoded once for the info hash and the torrent file
+const encodedFileLists = new WeakMap<TorrentFileInfo[], BencodeEncoded>();
+
+function* encodeFileListRanges(files: TorrentFileInfo[]) {
+    for (let start = 0; start < files.length; start += rangeFileCount) {
+        yield encodeFileListEntries(files.slice(start, start + rangeFileCount));
+    }
+}
+
+export function encodeFileList(files: TorrentFileInfo[]) {
+    let encodedFiles = encodedFileLists.get(files);
+    if (encodedFiles === undefined) {
+        encodedFiles = new BencodeEncoded([listStart, ...encodeFileListRanges(files), listEnd]);
+        encodedFileLists.set(files, encodedFiles);
+    }
+
+    return encodedFiles;
+}
+
+// Calculates the info hash of an info dictionary with a large file list (see minParallelFileCount)
+// The rest of the info dictionary is encoded first, then the parts are hashed in order on a worker, and each range of
+// the file list is encoded when the hashing reaches it. No worker is needed for the encoding, so the hashing can't wait
+// for a busy worker, and the encoded file list is reused for the torrent file
+export async function calculateInfoHashParallel(info: TorrentInfo & { files: TorrentFileInfo[] }) {
+    const { files } = info;
+
+    // The rest of the info dictionary, the file list is written between filesStartIndex and filesEndIndex
+    const buffer = new BencodeBuffer();
+    const [filesStartIndex, filesEndIndex] = new BencodeDict({
+        ...info,
+        files: new BencodeEncoded([]),
+    }).encodeWithValueRange(buffer, "files");
+    const chunks = buffer.getChunks();
+
+    const cachedFiles = encodedFileLists.get(files);
+    const encodedRanges: Uint8Array[] = [];
+
+    // The parts are copies (see getOutputParts), since they are transferred to the worker which calculates the hash
+    function* getInfoParts() {
+        yield* getOutputParts(chunks.slice(0, filesStartIndex));
+
+        if (cachedFiles !== undefined) {
+            yield* getOutputParts(cachedFiles.chunks);
+        } else {
+            yield* getOutputParts([listStart]);
+
+            for (const range of encodeFileListRanges(files)) {
+                encodedRanges.push(range);
+                yield* getOutputParts([range]);
+            }
+
+            yield* getOutputParts([listEnd]);
+        }
+
+        yield* getOutputParts(chunks.slice(filesEndIndex));
+    }
+
+    const infoHash = await calculatePartsHash(getInfoParts());
+    if (cachedFiles === undefined) {
+        encodedFileLists.set(files, new BencodeEncoded([listStart, ...encodedRanges, listEnd]));
+    }
+
+    return infoHash;
+}
+
+// Creates the bencode model of the torrent, large file lists are encoded with encodeFileList
+export function createTorrentModel(torrentObject: TorrentObject) {
+    const { files } = torrentObject.info;
+    if (files === undefined || files.length < minParallelFileCount) {
+        return new BencodeDict(torrentObject);
+    }
+
+    return new BencodeDict({
+        ...torrentObject,
+        info: { ...torrentObject.info, files: encodeFileList(files) },
+    });
+}
@@ -0,0 +1,184 @@
+/**
+Persistent cache of piece hashes for individual files, so unchanged files don't need to be read again
+when a torrent is created again from mostly the same files
+
+Only the pieces which are fully inside a single file can be cached, since the other pieces depend on the neighboring files
+The cache key contains everything that these pieces depend on: the path, size and modification date of the file,
+the piece size, and the position of the file relative to the piece boundaries
+The path is relative to the selected folder, so the source of the files is also part of the key (the archive, or the
+server and the folder of the URLs), otherwise the same names in different archives or on different servers would get
+each other's hashes
+Files without a modification date (e.g. from servers which don't send it) are not cached, their changes can't be
+detected
+*/
+
+import type { FileWithPath } from "./FileInput";
+import {
+    openDatabase,
+    pieceHashesLastUsedIndex,
+    requestToPromise,
+    StoreName,
+    transactionToPromise,
+} from "./Storage";
+
+// When the cache grows larger than this, the least recently used entries are removed
+const maxEntryCount = 200_000;
+const entryCountAfterCompaction = 150_000;
+
+interface CachedPieceHashes {
+    pieces: Uint8Array;
+    lastUsed: number;
+}
+
+export interface FullPieceRange {
+    firstPieceIndex: number;
+    pieceCount: number;
+}
+
+// Returns the range of the pieces which are fully inside the file
+export function getFullPieceRange(fileOffset: number, fileSize: number, blockSize: number): FullPieceRange {
+    const firstPieceIndex = Math.ceil(fileOffset / blockSize);
+    const endPieceIndex = Math.floor((fileOffset + fileSize) / blockSize);
+
+    return {
+        firstPieceIndex,
+        pieceCount: Math.max(endPieceIndex - firstPieceIndex, 0),
+    };
+}
+
+export class PieceHashCache {
+    private db: IDBDatabase;
+    private sourceId: string;
+
+    private constructor(db: IDBDatabase, sourceId: string) {
+        this.db = db;
+        this.sourceId = sourceId;
+    }
+
+    // Returns null if the cache is not available
+    // The source id identifies where the files are read from, see SelectedFileOrFolderInfo.sourceId
+    public static async open(sourceId = "") {
+        const db = await openDatabase();
+        return db === null ? null : new PieceHashCache(db, sourceId);
+    }
+
+    // Returns null if the file can't be cached
+    private getCacheKey(fileWithPath: FileWithPath, fileOffset: number, blockSize: number) {
+        const { path, file } = fileWithPath;
+        if (file.lastModified === 0) {
+            return null;
+        }
+
+        const relativePath = file.webkitRelativePath === "" ? path.join("/") : file.webkitRelativePath;
+        const alignmentOffset = fileOffset % blockSize;
+
+        return `${this.sourceId}|${relativePath}:${file.size}:${file.lastModified}:${blockSize}:${alignmentOffset}`;
+    }
+
+    // Returns the hashes of the full pieces of each file, or null for the files that are not in the cache
+    public async lookup(inputFiles: FileWithPath[], blockSize: number) {
+        const result: (Uint8Array | null)[] = new Array(inputFiles.length).fill(null);
+
+        try {
+            const transaction = this.db.transaction(StoreName.PieceHashes, "readonly");
+            const store = transaction.objectStore(StoreName.PieceHashes);
+
+            const requests: Promise<void>[] = [];
+
+            let fileOffset = 0;
+            for (let i = 0; i < inputFiles.length; ++i) {
+                const fileWithPath = inputFiles[i];
+                const { pieceCount } = getFullPieceRange(fileOffset, fileWithPath.file.size, blockSize);
+
+                const key = pieceCount === 0 ? null : this.getCacheKey(fileWithPath, fileOffset, blockSize);
+                if (key !== null) {
+                    requests.push(
+                        requestToPromise<CachedPieceHashes | undefined>(store.get(key)).then(cached => {
+                            if (cached !== undefined && cached.pieces.length === pieceCount * 20) {
+                                result[i] = cached.pieces;
+                            }
+                        }),
+                    );
+                }
+
+                fileOffset += fileWithPath.file.size;
+            }
+
+            await Promise.all(requests);
+        } catch {
+            // Everything will be hashed
+            result.fill(null);
+        }
+
+        return result;
+    }
+
+    // Stores the hashes of the full pieces of each file, and removes old entries if the cache is too large
+    public async update(inputFiles: FileWithPath[], blockSize: number, pieces: Uint8Array) {
+        const lastUsed = Date.now();
+
+        try {
+            const transaction = this.db.transaction(StoreName.PieceHashes, "readwrite");
+            const store = transaction.objectStore(StoreName.PieceHashes);
+
+            let fileOffset = 0;
+            for (const fileWithPath of inputFiles) {
+                const { firstPieceIndex, pieceCount } = getFullPieceRange(
+                    fileOffset,
+                    fileWithPath.file.size,
+                    blockSize,
+                );
+
+                const key = pieceCount === 0 ? null : this.getCacheKey(fileWithPath, fileOffset, blockSize);
+                if (key !== null) {
+                    const cached: CachedPieceHashes = {
+                        pieces: pieces.slice(firstPieceIndex * 20, (firstPieceIndex + pieceCount) * 20),
+                        lastUsed,
+                    };
+
+                    store.put(cached, key);
+                }
+
+                fileOffset += fileWithPath.file.size;
+            }
+
+            await transactionToPromise(transaction);
+
+            await this.compact();
+        } catch {
+            // The cache is only an optimization
+        }
+    }
+
+    private async compact() {
+        const transaction = this.db.transaction(StoreName.PieceHashes, "readwrite");
+        const store = transaction.objectStore(StoreName.PieceHashes);
+
+        const entryCount = await requestToPromise(store.count());
+        if (entryCount <= maxEntryCount) {
+            return;
+        }
+
+        // Remove the least recently used entries
+        let remainingDeleteCount = entryCount - entryCountAfterCompaction;
+        const cursorRequest = store.index(pieceHashesLastUsedIndex).openKeyCursor();
+
+        await new Promise<void>((resolve, reject) => {
+            cursorRequest.onsuccess = () => {
+                const cursor = cursorRequest.result;
+                if (cursor === null || remainingDeleteCount <= 0) {
+                    resolve();
+                    return;
+                }
+
+                store.delete(cursor.primaryKey);
+                --remainingDeleteCount;
+                cursor.continue();
+            };
+
+            cursorRequest.onerror = () => reject(cursorRequest.error);
+        });
+
+        await transactionToPromise(transaction);
+    }
+}
@@ -0,0 +1,280 @@
+/**
+Calculates the info hash together with the pieces
+
+Every field of the info dictionary except the pieces is known before hashing starts, so the encoded dictionary is
+hashed up to the pieces right away, and the pieces are added as they are completed in order. When the last piece is
+completed, only the end of the dictionary (a few bytes) is left, so the info hash is ready together with the pieces,
+instead of encoding and hashing the whole dictionary again after them
+The hash is calculated on the main thread with a resumable sha-1 context (see {@link Sha1Context}), since it's only 20
+bytes for each piece, and the workers are kept free for hashing the pieces. The part before the pieces can be tens of
+MB with a large file list, so it's hashed in slices in the background, while the workers start hashing the pieces
+*/
+
+import { BencodeBuffer, BencodeDict, BencodeEncoded } from "./Bencode";
+import { encodeFileList, minParallelFileCount } from "./ParallelEncoding";
+import type { TorrentInfo } from "./TorrentObject";
+import { MB } from "./Util";
+
+// Bytes of the dictionary before the pieces which are hashed between yields to the event loop (about 6ms)
+const prefixSliceSize = 1 * MB;
+
+// Sha-1 hash of a message which is added in parts (https://datatracker.ietf.org/doc/html/rfc3174)
+// The state is the hash of the full blocks so far and the bytes of the last partial block, so more data can be added at
+// any time
+class Sha1Context {
+    private readonly state = new Int32Array([0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0]);
+    private readonly block = new Uint8Array(64);
+    private readonly words = new Int32Array(80);
+    private blockLength = 0; // Bytes in the last partial block
+    private messageLength = 0;
+
+    public update(bytes: Uint8Array) {
+        this.messageLength += bytes.length;
+
+        let offset = 0;
+        if (this.blockLength !== 0) {
+            offset = Math.min(64 - this.blockLength, bytes.length);
+            this.block.set(bytes.subarray(0, offset), this.blockLength);
+            this.blockLength += offset;
+
+            if (this.blockLength < 64) {
+                return;
+            }
+
+            this.processBlock(this.block, 0);
+            this.blockLength = 0;
+        }
+
+        for (; offset + 64 <= bytes.length; offset += 64) {
+            this.processBlock(bytes, offset);
+        }
+
+        this.block.set(bytes.subarray(offset));
+        this.blockLength = bytes.length - offset;
+    }
+
+    // Finishes the message, the context can't be used after this
+    public digest() {
+        const bitLength = this.messageLength * 8;
+
+        // 0x80, zeros until 8 bytes before the end of a block, and the length of the message in bits
+        const padding = new Uint8Array((this.blockLength < 56 ? 64 : 128) - this.blockLength);
+        padding[0] = 0x80;
+
+        const paddingView = new DataView(padding.buffer);
+        paddingView.setUint32(padding.length - 8, Math.floor(bitLength / 0x100000000));
+        paddingView.setUint32(padding.length - 4, bitLength >>> 0);
+        this.update(padding);
+
+        const result = new Uint8Array(20);
+        const resultView = new DataView(result.buffer);
+        for (let i = 0; i < 5; ++i) {
+            resultView.setInt32(i * 4, this.state[i]);
+        }
+
+        return result;
+    }
+
+    private processBlock(bytes: Uint8Array, offset: number) {
+        const w = this.words;
+        for (let i = 0; i < 16; ++i) {
+            const j = offset + i * 4;
+            w[i] = (bytes[j] << 24) | (bytes[j + 1] << 16) | (bytes[j + 2] << 8) | bytes[j + 3];
+        }
+
+        for (let i = 16; i < 80; ++i) {
+            const x = w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16];
+            w[i] = (x << 1) | (x >>> 31);
+        }
+
+        const state = this.state;
+        let a = state[0];
+        let b = state[1];
+        let c = state[2];
+        let d = state[3];
+        let e = state[4];
+
+        // The rounds are in 4 loops, so the function of the round is not selected in every iteration
+        for (let i = 0; i < 20; ++i) {
+            const temp = (((a << 5) | (a >>> 27)) + ((b & c) | (~b & d)) + e + w[i] + 0x5a827999) | 0;
+            e = d;
+            d = c;
+            c = (b << 30) | (b >>> 2);
+            b = a;
+            a = temp;
+        }
+
+        for (let i = 20; i < 40; ++i) {
+            const temp = (((a << 5) | (a >>> 27)) + (b ^ c ^ d) + e + w[i] + 0x6ed9eba1) | 0;
+            e = d;
+            d = c;
+            c = (b << 30) | (b >>> 2);
+            b = a;
+            a = temp;
+        }
+
+        for (let i = 40; i < 60; ++i) {
+            const temp = (((a << 5) | (a >>> 27)) + ((b & c) | (b & d) | (c & d)) + e + w[i] + 0x8f1bbcdc) | 0;
+            e = d;
+            d = c;
+            c = (b << 30) | (b >>> 2);
+            b = a;
+            a = temp;
+        }
+
+        for (let i = 60; i < 80; ++i) {
+            const temp = (((a << 5) | (a >>> 27)) + (b ^ c ^ d) + e + w[i] + 0xca62c1d6) | 0;
+            e = d;
+            d = c;
+            c = (b << 30) | (b >>> 2);
+            b = a;
+            a = temp;
+        }
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+    }
+}
+
+// The calculations of the info dictionaries which are being hashed, or were hashed
+const progressiveInfoHashes = new WeakMap<TorrentInfo, ProgressiveInfoHash>();
+
+export class ProgressiveInfoHash {
+    private readonly context = new Sha1Context();
+    private readonly info: TorrentInfo;
+    private readonly fields: TorrentInfo; // The fields of the info dictionary when it was encoded
+    private readonly pieceCount: number;
+    private readonly suffixChunks: readonly Uint8Array[]; // The encoded dictionary after the pieces
+
+    private pieces: Uint8Array | null = null;
+    private completedPieceCount = 0; // Pieces from the beginning without gaps, these are hashed already
+    private readonly completedRanges = new Map<number, number>(); // Start index and count of the pieces after gaps
+    private isPrefixHashed = false; // The pieces are hashed after the part of the dictionary before them
+    private prefixHashing: Promise<void> = Promise.resolve();
+    private infoHash: string | null = null;
+
+    private constructor(info: TorrentInfo, pieceCount: number, suffixChunks: readonly Uint8Array[]) {
+        this.info = info;
+        this.fields = { ...info };
+        this.pieceCount = pieceCount;
+        this.suffixChunks = suffixChunks;
+    }
+
+    // Encodes the info dictionary without its pieces, and starts hashing it up to the pieces
+    // The info dictionary shouldn't be changed until the hashing is finished, except its pieces
+    public static start(info: TorrentInfo, pieceCount: number) {
+        // Large file lists are encoded without BencodeDict objects, and the encoded list is reused for the torrent file
+        const { files } = info;
+        const encodedFiles =
+            files !== undefined && files.length >= minParallelFileCount ? encodeFileList(files) : files;
+
+        const buffer = new BencodeBuffer();
+        const [piecesStartIndex, piecesEndIndex] = new BencodeDict({
+            ...info,
+            files: encodedFiles,
+            pieces: new BencodeEncoded([]),
+        }).encodeWithValueRange(buffer, "pieces");
+        const chunks = buffer.getChunks();
+
+        // Length of the pieces string
+        const piecesHeader = new BencodeBuffer();
+        piecesHeader.writeTextUTF8(`${pieceCount * 20}:`);
+
+        const progressiveInfoHash = new ProgressiveInfoHash(info, pieceCount, chunks.slice(piecesEndIndex));
+        const prefixChunks = [...chunks.slice(0, piecesStartIndex), piecesHeader.getBytes()];
+        progressiveInfoHash.prefixHashing = progressiveInfoHash.hashPrefix(prefixChunks);
+
+        progressiveInfoHashes.set(info, progressiveInfoHash);
+        return progressiveInfoHash;
+    }
+
+    // Should be called when the hashes of the given pieces are written into the pieces array
+    // The pieces are hashed in order, so the ones after a gap are hashed when the gap is completed
+    public onPiecesCompleted(pieces: Uint8Array, startPieceIndex: number, pieceCount: number) {
+        this.pieces = pieces;
+        if (pieceCount === 0) {
+            return;
+        }
+
+        this.completedRanges.set(startPieceIndex, pieceCount);
+        if (this.isPrefixHashed) {
+            this.hashCompletedPieces(pieces);
+        }
+    }
+
+    // The info hash, if every piece is hashed, and the info dictionary was not changed since it was encoded
+    // Waits until the dictionary before the pieces is hashed, with a small torrent it can take longer than the pieces
+    public async getInfoHash(info: TorrentInfo) {
+        await this.prefixHashing;
+        if (this.infoHash === null || info !== this.info || info.pieces !== this.pieces) {
+            return null;
+        }
+
+        const fields = this.fields as Record<string, unknown>;
+        const currentFields = info as Record<string, unknown>;
+        for (const key of new Set([...Object.keys(fields), ...Object.keys(currentFields)])) {
+            if (key !== "pieces" && currentFields[key] !== fields[key]) {
+                return null;
+            }
+        }
+
+        return this.infoHash;
+    }
+
+    // Hashes the completed pieces from the end of the hashed ones, up to the next gap
+    private hashCompletedPieces(pieces: Uint8Array) {
+        const hashedPieceCount = this.completedPieceCount;
+        let count: number | undefined;
+        while ((count = this.completedRanges.get(this.completedPieceCount)) !== undefined) {
+            this.completedRanges.delete(this.completedPieceCount);
+            this.completedPieceCount += count;
+        }
+
+        if (this.completedPieceCount !== hashedPieceCount) {
+            this.context.update(pieces.subarray(hashedPieceCount * 20, this.completedPieceCount * 20));
+
+            if (this.completedPieceCount === this.pieceCount) {
+                this.finish();
+            }
+        }
+    }
+
+    // Hashes the dictionary up to the pieces, and the pieces which were completed in the meantime
+    // The main thread is yielded after each slice, so the page stays responsive with a large file list
+    private async hashPrefix(chunks: readonly Uint8Array[]) {
+        let sliceLength = 0;
+        for (const chunk of chunks) {
+            for (let offset = 0; offset < chunk.length; offset += prefixSliceSize) {
+                const slice = chunk.subarray(offset, offset + prefixSliceSize);
+                this.context.update(slice);
+
+                sliceLength += slice.length;
+                if (sliceLength >= prefixSliceSize) {
+                    sliceLength = 0;
+                    await new Promise(resolve => setTimeout(resolve));
+                }
+            }
+        }
+
+        this.isPrefixHashed = true;
+        if (this.pieces !== null) {
+            this.hashCompletedPieces(this.pieces);
+        }
+    }
+
+    private finish() {
+        for (const chunk of this.suffixChunks) {
+            this.context.update(chunk);
+        }
+
+        this.infoHash = [...this.context.digest()].map(byte => byte.toString(16).padStart(2, "0")).join("");
+    }
+}
+
+// Returns the info hash if it was calculated together with the pieces, see ProgressiveInfoHash
+export async function getProgressiveInfoHash(info: TorrentInfo) {
+    return (await progressiveInfoHashes.get(info)?.getInfoHash(info)) ?? null;
+}
@@ -10,6 +10,8 @@ Use the {@link SetRemoteObject} function on the remote side, and the {@link Crea
 
 Notes:
 - Functions of the remote object will be made async
+- Functions of the remote object can also be async, their results are awaited before sending them back
+  The calls are processed one by one, so the transfer list of a call is never mixed with the one of another call
 - Function parameter types must be clonable with the structured clone algorithm (so no functions, DOM nodes, etc. are allowed)
 */
 
@@ -84,14 +86,23 @@ const initPromise = new Promise<any>(res => (initResolver = res));
 let initDataReceived = false;
 const pendingMessages: RemoteProxyMessage[] = [];
 
-function ProcessMessage(message: RemoteProxyMessage, callbacks: RemoteProxyCallbacks) {
+// The next message is only processed when the response of the previous one is sent
+// Errors while sending (e.g. the result can't be cloned) don't stop the processing of the next messages
+let lastProcessedMessage = Promise.resolve();
+function EnqueueMessage(message: RemoteProxyMessage, callbacks: RemoteProxyCallbacks) {
+    lastProcessedMessage = lastProcessedMessage
+        .then(() => ProcessMessage(message, callbacks))
+        .catch(ex => callbacks.onRemoteError(ex));
+}
+
+async function ProcessMessage(message: RemoteProxyMessage, callbacks: RemoteProxyCallbacks) {
     if (message.type !== MessageType.FunctionCall) {
         return;
     }
 
-    const result = ((): ResponseResult => {
+    const result = await (async (): Promise<ResponseResult> => {
         try {
-            const result = (remoteObject as any)[message.functionName](...message.args);
+            const result = await (remoteObject as any)[message.functionName](...message.args);
 
             return {
                 success: true,
@@ -145,7 +156,7 @@ export async function SetRemoteObject<T extends object, TInitData>(
         if (message.type === MessageType.Initialize) {
             initResolver(message.data);
         } else if (initDataReceived && remoteObject !== null) {
-            ProcessMessage(message, callbacks);
+            EnqueueMessage(message, callbacks);
         } else {
             pendingMessages.push(message);
         }
@@ -161,7 +172,7 @@ export async function SetRemoteObject<T extends object, TInitData>(
     initDataReceived = true;
 
     for (const msg of pendingMessages) {
-        ProcessMessage(msg, callbacks);
+        EnqueueMessage(msg, callbacks);
     }
 
     pendingMessages.length = 0;
@@ -10,6 +10,7 @@ Use {@link Transfer} and {@link TransferTypedArray} to transfer objects instead
 (this can be used in both the main thread and the worker thread)
 These functions will transfer the objects in the next proxy call (globally), so make sure to
 call the transfer functions directly before that
+On the worker thread, the calls are processed one by one, so async functions can call them anywhere before returning
 */
 
 /// <reference lib="webworker" />
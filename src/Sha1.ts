@@ -1,37 +1,56 @@
-import type { Sha1WorkerObject } from "./Sha1Worker";
+import type { SegmentHashFeatures, Sha1Backend, Sha1WorkerObject } from "./Sha1Worker";
 import Sha1Worker from "./Sha1Worker?worker";
 import Sha1Wasm from "./wasm/Sha1.wasm?url";
 import Sha1SimdWasm from "./wasm/Sha1Simd.wasm?url";
 import SimdDetectionWasm from "./wasm/SimdDetection.wasm?url";
 import { CreateWorkerProxy, TransferTypedArray } from "./RemoteWorkerProxy";
 import type { RemoteProxy } from "./RemoteProxy";
+import type { HashingMetrics } from "./HashingMetrics";
 
 // Use 8 workers max, reading from disk will be the slowest anyways
 const maxWorkerCount = Math.min(navigator.hardwareConcurrency || 1, 8);
 
 type WorkerObject = RemoteProxy<Sha1WorkerObject>;
 
-function createWorkerPool(workers: WorkerObject[]) {
+function createWorkerPool(workers: WorkerObject[], wasmKernel: string, canHashLargePieces: boolean) {
     const waitingResolvers: ((worker: WorkerObject) => void)[] = [];
+    const workerCount = workers.length;
+
+    // The faster backend for each piece size, based on a benchmark
+    const selectedBackends = new Map<number, Promise<Sha1Backend>>();
 
     let activeCreationId = -1;
 
-    const computeHashes = async (data: Uint8Array[], creationId: number | null) => {
+    // Runs which are started with beginRun (see TorrentCreator.ts), these can run next to each other, and next to the
+    // run of the app, which is set with setCreationId
+    // Their ids are negative, so they are never the same as the ids of the app
+    const activeRunIds = new Set<number>();
+    let lastRunId = -1;
+
+    // Runs the callback on the next available worker, or returns null if the run was cancelled
+    const runOnWorker = async <T>(
+        creationId: number | null,
+        metrics: HashingMetrics | undefined,
+        callback: (worker: WorkerObject) => Promise<T>,
+    ) => {
         let worker: WorkerObject;
 
         if (workers.length !== 0) {
             worker = workers.pop()!;
         } else {
-            worker = await new Promise<WorkerObject>(res => waitingResolvers.push(res));
-        }
+            const waitStartTime = performance.now();
+            metrics?.onWorkerQueued(waitingResolvers.length + 1);
 
-        const isCancelled = creationId !== null && creationId !== activeCreationId;
+            worker = await new Promise<WorkerObject>(res => waitingResolvers.push(res));
 
-        if (!isCancelled) {
-            data.forEach(TransferTypedArray);
+            if (metrics !== undefined) {
+                metrics.workerWaitMs += performance.now() - waitStartTime;
+            }
         }
 
-        const result = isCancelled ? null : await worker.computeHashes(data);
+        const isCancelled = creationId !== null && creationId !== activeCreationId && !activeRunIds.has(creationId);
+
+        const result = isCancelled ? null : await callback(worker);
 
         const waitingResolver = waitingResolvers.pop();
         if (waitingResolver === undefined) {
@@ -43,13 +62,94 @@ function createWorkerPool(workers: WorkerObject[]) {
         return result;
     };
 
+    const computeHashes = (
+        data: Uint8Array[],
+        creationId: number | null,
+        metrics?: HashingMetrics,
+        backend: Sha1Backend = "wasm",
+    ) =>
+        runOnWorker(creationId, metrics, worker => {
+            data.forEach(TransferTypedArray);
+            return worker.computeHashes(data, backend);
+        });
+
+    // See Sha1WorkerObject.computeSegmentHashes
+    const computeSegmentHashes = (
+        buffers: Uint8Array[],
+        segments: Uint32Array,
+        pieceSegmentCounts: Uint32Array,
+        creationId: number | null,
+        metrics?: HashingMetrics,
+        features?: SegmentHashFeatures,
+        backend: Sha1Backend = "wasm",
+    ) =>
+        runOnWorker(creationId, metrics, worker => {
+            buffers.forEach(TransferTypedArray);
+            return worker.computeSegmentHashes(buffers, segments, pieceSegmentCounts, features, backend);
+        });
+
+    // Hashes the concatenation of the parts on a single worker, the parts are transferred to the worker one by one
+    // See Sha1WorkerObject.beginStreamedHash
+    const computeStreamedHash = (parts: Iterable<Uint8Array> | AsyncIterable<Uint8Array>) =>
+        runOnWorker(null, undefined, async worker => {
+            await worker.beginStreamedHash();
+            for await (const part of parts) {
+                TransferTypedArray(part);
+                await worker.updateStreamedHash(part);
+            }
+
+            return worker.endStreamedHash();
+        });
+
     const setCreationId = async (id: number) => {
         activeCreationId = id;
     };
 
+    // Returns the creation id of a new run, which is active until endRun is called with it
+    const beginRun = () => {
+        const id = --lastRunId;
+        activeRunIds.add(id);
+        return id;
+    };
+
+    // The calls of the run which are still waiting for a worker are cancelled
+    const endRun = (id: number) => {
+        activeRunIds.delete(id);
+    };
+
+    // Benchmarks the backends with the given piece size (only once for each size), and returns the faster one
+    // The backend is passed to the hashing calls of the run, the workers don't keep a selected backend
+    const selectBackend = (pieceSize: number) => {
+        let backend = selectedBackends.get(pieceSize);
+        if (backend === undefined) {
+            backend = runOnWorker(null, undefined, worker => worker.benchmark(pieceSize)).then(result => {
+                const isSubtleCryptoFaster =
+                    result !== null && result.subtleCrypto !== null && result.subtleCrypto > result.wasm;
+                return isSubtleCryptoFaster ? "subtle-crypto" : "wasm";
+            });
+
+            selectedBackends.set(pieceSize, backend);
+        }
+
+        return backend;
+    };
+
+    // Name of the kernel of the backend, for the metrics
+    const getKernel = (backend: Sha1Backend) => (backend === "wasm" ? wasmKernel : backend);
+
     return {
         computeHashes,
+        computeSegmentHashes,
+        computeStreamedHash,
         setCreationId,
+        beginRun,
+        endRun,
+        selectBackend,
+        getKernel,
+        // Pieces larger than 16MB can only be hashed with the streaming functions of the wasm module, or with
+        // SubtleCrypto, the selected backend is the one which can hash them
+        canHashLargePieces,
+        workerCount,
     };
 }
 
@@ -96,7 +196,10 @@ async function initializeWorkers() {
         workers.push(proxy);
     }
 
-    return createWorkerPool(workers);
+    // Every worker has the same wasm module, so asking one of them is enough
+    const canHashLargePieces = await workers[0].canHashLargePieces();
+
+    return createWorkerPool(workers, simdSupported ? "wasm-simd128" : "wasm", canHashLargePieces);
 }
 
 export const workerPoolPromise = initializeWorkers();
@@ -1,9 +1,49 @@
 import { SetWorkerObject, TransferTypedArray } from "./RemoteWorkerProxy";
 
 type Ptr = number;
+
+export type Sha1Backend = "wasm" | "subtle-crypto";
+
+// Amount of data hashed with each backend when benchmarking
+const benchmarkSize = 8 * 1024 * 1024;
+// Number of buffers in the batch of the benchmark, like the reads of a few files
+const benchmarkReadCount = 3;
+
+const hashResultSize = 20; // 20 bytes per sha-1 hash
+// Must be the same as maxSegmentCount and maxMessageCount in sha1.cpp
+const maxSegmentCount = 4096;
+const maxMessageCount = 4096;
+// Size of the memory buffer in sha1.cpp, without the extra block
+const maxSegmentBuffersSize = 16 * 1024 * 1024;
+// Largest message which can be hashed with a single sha1 call in every build, larger messages are hashed in parts
+const maxMessageSize = 16 * 1024 * 1024;
+
+// Must be the same as FusedFeature and the result flags of sha1SegmentsFused in sha1.cpp
+const fusedDetectZero = 1;
+const fusedFlagAllZero = 1;
+
+// Computations which are done together with the hashing of the pieces, over the same data
+export interface SegmentHashFeatures {
+    // Finds the pieces which contain only zero bytes
+    // Pieces with multiple segments are checked by sha1SegmentsFused while they are hashed, pieces with a single
+    // segment are still hashed with the multi-buffer kernel, which is faster, and checked in a separate pass over the
+    // original buffers (see isAllZero), that costs about one more read of their data
+    // With SubtleCrypto and older builds of the wasm module every piece is checked in the separate pass
+    detectZeroPieces?: boolean;
+}
+
 type WasmModule = WebAssembly.Exports & {
     getMemoryBuffer: () => Ptr;
     sha1: (sizeInBytes: number) => Ptr;
+    // Not available in older builds of the wasm module
+    getSegmentTable?: () => Ptr;
+    sha1Segments?: (segmentCount: number) => Ptr;
+    getMessageTable?: () => Ptr;
+    sha1Multi?: (messageCount: number) => Ptr;
+    sha1SegmentsBegin?: () => void;
+    sha1SegmentsUpdate?: (segmentCount: number) => void;
+    sha1SegmentsEnd?: () => Ptr;
+    sha1SegmentsFused?: (segmentCount: number, features: number) => Ptr;
     _initialize: () => void;
     memory: WebAssembly.Memory;
 };
@@ -12,6 +52,11 @@ export class Sha1WorkerObject {
     private module: WasmModule;
     private HEAPU8: Uint8Array;
 
+    // State of the message which is hashed with beginStreamedHash, updateStreamedHash and endStreamedHash
+    private streamedBufferLength = 0; // Bytes in the wasm memory buffer which are not hashed yet
+    private streamedSegmentCount = 0;
+    private streamedHashParts: Uint8Array[] | null = null; // For builds of the wasm module without streaming
+
     constructor(Module: WasmModule) {
         Module._initialize();
         this.HEAPU8 = new Uint8Array(Module.memory.buffer);
@@ -19,14 +64,173 @@ export class Sha1WorkerObject {
         this.module = Module;
     }
 
-    public computeHashes(inputs: Uint8Array[]) {
-        const ptr = this.module.getMemoryBuffer();
+    // The backend is given with each call, so the calls of runs with different piece sizes can use different backends
+    public async computeHashes(inputs: Uint8Array[], backend: Sha1Backend = "wasm") {
+        const result =
+            backend === "subtle-crypto"
+                ? await this.computeHashesSubtleCrypto(inputs)
+                : this.computeHashesWasm(inputs);
+
+        // Transfer back the original buffers to reuse memory
+        // The result buffer is not transferred, because it's relatively small
+        inputs.forEach(TransferTypedArray);
+
+        return {
+            result,
+            originalInputs: inputs,
+        };
+    }
+
+    // Calculates the hashes of pieces which are made of segments of the input buffers
+    // Each segment is 3 numbers in the segments array: buffer index, offset, and length
+    // The segments of each piece follow each other, and the number of segments of each piece is in pieceSegmentCounts
+    // With detectZeroPieces, zeroPieces has a byte for each piece, which is 1 if the piece contains only zero bytes
+    public async computeSegmentHashes(
+        buffers: Uint8Array[],
+        segments: Uint32Array,
+        pieceSegmentCounts: Uint32Array,
+        features: SegmentHashFeatures = {},
+        backend: Sha1Backend = "wasm",
+    ) {
+        const zeroPieces = features.detectZeroPieces ? new Uint8Array(pieceSegmentCounts.length) : null;
 
-        const hashResultSize = 20; // 20 bytes per sha-1 hash
+        let result: Uint8Array;
+        if (backend === "subtle-crypto") {
+            result = await this.computeSegmentHashesSubtleCrypto(buffers, segments, pieceSegmentCounts);
+            if (zeroPieces !== null) {
+                findZeroPieces(buffers, segments, pieceSegmentCounts, zeroPieces);
+            }
+        } else {
+            result = this.computeSegmentHashesWasm(buffers, segments, pieceSegmentCounts, zeroPieces);
+        }
+
+        // Transfer back the original buffers to reuse memory
+        buffers.forEach(TransferTypedArray);
+
+        return {
+            result,
+            zeroPieces,
+            originalInputs: buffers,
+        };
+    }
+
+    // Hashes a message which is received in multiple parts, so the whole message is never in memory at once
+    // (e.g. the info dictionary of a torrent with a long pieces list)
+    // All parts of a message must be sent to the same worker, without other calls in between
+    public beginStreamedHash() {
+        if (this.module.sha1SegmentsBegin === undefined) {
+            // Older builds of the wasm module can't hash in parts, so the parts are collected and hashed at the end
+            this.streamedHashParts = [];
+        } else {
+            this.streamedHashParts = null;
+            this.beginStreamedHashWasm();
+        }
+    }
+
+    public updateStreamedHash(part: Uint8Array) {
+        if (this.streamedHashParts === null) {
+            this.updateStreamedHashWasm(part);
+        } else {
+            this.streamedHashParts.push(part);
+        }
+    }
+
+    public async endStreamedHash() {
+        if (this.streamedHashParts === null) {
+            return this.endStreamedHashWasm();
+        }
+
+        const parts = this.streamedHashParts;
+        this.streamedHashParts = null;
+
+        const message = new Uint8Array(parts.reduce((size, part) => size + part.length, 0));
+        let writeOffset = 0;
+        for (const part of parts) {
+            message.set(part, writeOffset);
+            writeOffset += part.length;
+        }
+
+        return message.length > maxMessageSize && isSubtleCryptoAvailable()
+            ? await this.computeHashesSubtleCrypto([message])
+            : this.computeHashesWasm([message]);
+    }
+
+    // Pieces larger than the wasm memory buffer (32MB and 64MB) can be hashed with the streaming functions of the wasm
+    // module, or with SubtleCrypto
+    public canHashLargePieces() {
+        return this.module.sha1SegmentsUpdate !== undefined || isSubtleCryptoAvailable();
+    }
+
+    // Measures the throughput of each backend with the given piece size, in bytes per millisecond
+    // The result is null for backends which are not available, and 0 if the wasm module can't hash this piece size
+    // The same path as computeSegmentHashes is measured, on a batch which is read from a few files, so some of the
+    // pieces are made of multiple segments
+    public async benchmark(pieceSize: number) {
+        const pieceCount = Math.max(Math.floor(benchmarkSize / pieceSize), 1);
+        const batchLength = pieceCount * pieceSize;
+
+        const buffers: Uint8Array[] = [];
+        for (let i = 0; i < benchmarkReadCount; ++i) {
+            const start = Math.floor((batchLength * i) / benchmarkReadCount);
+            const end = Math.floor((batchLength * (i + 1)) / benchmarkReadCount);
+            buffers.push(new Uint8Array(end - start).fill(i + 1));
+        }
+
+        const segments: number[] = [];
+        const pieceSegmentCounts = new Uint32Array(pieceCount);
+        let bufferIndex = 0;
+        let bufferOffset = 0;
+        for (let i = 0; i < pieceCount; ++i) {
+            for (let remaining = pieceSize; remaining > 0; ++pieceSegmentCounts[i]) {
+                const length = Math.min(remaining, buffers[bufferIndex].length - bufferOffset);
+                segments.push(bufferIndex, bufferOffset, length);
+
+                remaining -= length;
+                bufferOffset += length;
+                if (bufferOffset === buffers[bufferIndex].length) {
+                    ++bufferIndex;
+                    bufferOffset = 0;
+                }
+            }
+        }
+
+        const segmentsArray = new Uint32Array(segments);
+
+        const measure = async (callback: () => Promise<unknown>) => {
+            // The first call might include some one-time initialization
+            await callback();
+
+            const startTime = performance.now();
+            await callback();
+            const elapsedMs = Math.max(performance.now() - startTime, 0.001);
+
+            return batchLength / elapsedMs;
+        };
+
+        // Older builds of the wasm module can't hash pieces larger than their memory buffer
+        const isWasmAvailable = pieceSize <= maxMessageSize || this.module.sha1SegmentsUpdate !== undefined;
+
+        return {
+            wasm: isWasmAvailable
+                ? await measure(async () => this.computeSegmentHashesWasm(buffers, segmentsArray, pieceSegmentCounts))
+                : 0,
+            subtleCrypto: isSubtleCryptoAvailable()
+                ? await measure(() => this.computeSegmentHashesSubtleCrypto(buffers, segmentsArray, pieceSegmentCounts))
+                : null,
+        };
+    }
+
+    private computeHashesWasm(inputs: Uint8Array[]) {
+        const ptr = this.module.getMemoryBuffer();
 
         const result = new Uint8Array(inputs.length * hashResultSize);
         for (let i = 0; i < inputs.length; ++i) {
             const bytes = inputs[i];
+            if (bytes.length > maxMessageSize) {
+                result.set(this.computeStreamedHashWasm([bytes]), i * hashResultSize);
+                continue;
+            }
+
             this.HEAPU8.set(bytes, ptr);
 
             const resultPtr = this.module.sha1(bytes.length);
@@ -35,15 +239,343 @@ export class Sha1WorkerObject {
             result.set(this.HEAPU8.subarray(resultPtr, resultPtr + hashResultSize), offset);
         }
 
-        // Transfer back the original buffers to reuse memory
-        // The result buffer is not transferred, because it's relatively small
-        inputs.forEach(TransferTypedArray);
+        return result;
+    }
 
-        return {
-            result,
-            originalInputs: inputs,
-        };
+    private async computeHashesSubtleCrypto(inputs: Uint8Array[]) {
+        // All digests are started at once, so the browser can process them without waiting for each call
+        const hashes = await Promise.all(
+            inputs.map(input => crypto.subtle.digest("SHA-1", input as Uint8Array<ArrayBuffer>)),
+        );
+
+        const result = new Uint8Array(inputs.length * hashResultSize);
+        for (let i = 0; i < hashes.length; ++i) {
+            result.set(new Uint8Array(hashes[i]), i * hashResultSize);
+        }
+
+        return result;
     }
+
+    private computeSegmentHashesSubtleCrypto(
+        buffers: Uint8Array[],
+        segments: Uint32Array,
+        pieceSegmentCounts: Uint32Array,
+    ) {
+        // Pieces with a single segment are hashed directly from the buffer, other pieces need to be concatenated
+        const pieces: Uint8Array[] = [];
+
+        let segmentIndex = 0;
+        for (const segmentCount of pieceSegmentCounts) {
+            const pieceSegments: Uint8Array[] = [];
+            let pieceLength = 0;
+
+            for (let j = 0; j < segmentCount; ++j, ++segmentIndex) {
+                const buffer = buffers[segments[segmentIndex * 3]];
+                const offset = segments[segmentIndex * 3 + 1];
+                const length = segments[segmentIndex * 3 + 2];
+
+                pieceSegments.push(buffer.subarray(offset, offset + length));
+                pieceLength += length;
+            }
+
+            if (pieceSegments.length === 1) {
+                pieces.push(pieceSegments[0]);
+            } else {
+                const piece = new Uint8Array(pieceLength);
+                let writeOffset = 0;
+                for (const pieceSegment of pieceSegments) {
+                    piece.set(pieceSegment, writeOffset);
+                    writeOffset += pieceSegment.length;
+                }
+
+                pieces.push(piece);
+            }
+        }
+
+        return this.computeHashesSubtleCrypto(pieces);
+    }
+
+    // Also fills zeroPieces if it's given, see SegmentHashFeatures.detectZeroPieces
+    private computeSegmentHashesWasm(
+        buffers: Uint8Array[],
+        segments: Uint32Array,
+        pieceSegmentCounts: Uint32Array,
+        zeroPieces: Uint8Array | null = null,
+    ) {
+        const ptr = this.module.getMemoryBuffer();
+        let isZeroDetectionDone = false;
+
+        const result = new Uint8Array(pieceSegmentCounts.length * hashResultSize);
+
+        const { getSegmentTable, sha1Segments } = this.module;
+        const canUseSegments =
+            getSegmentTable !== undefined &&
+            sha1Segments !== undefined &&
+            buffers.reduce((size, buffer) => size + buffer.length, 0) <= maxSegmentBuffersSize &&
+            pieceSegmentCounts.every(segmentCount => segmentCount <= maxSegmentCount);
+
+        if (canUseSegments) {
+            // Copy all buffers into the wasm memory once, and hash the pieces from there
+            const bufferOffsets: number[] = [];
+            let writeOffset = 0;
+            for (const buffer of buffers) {
+                this.HEAPU8.set(buffer, ptr + writeOffset);
+                bufferOffsets.push(writeOffset);
+                writeOffset += buffer.length;
+            }
+
+            const segmentTable = new Uint32Array(this.HEAPU8.buffer, getSegmentTable(), maxSegmentCount * 2);
+
+            // Pieces with multiple segments are checked for zero bytes while they are hashed, if the fused kernel is
+            // available
+            const { sha1SegmentsFused } = this.module;
+            const isFused = zeroPieces !== null && sha1SegmentsFused !== undefined;
+            isZeroDetectionDone = isFused;
+
+            // Pieces with a single segment are hashed together with the multi-buffer kernel, if it's available
+            const { getMessageTable, sha1Multi } = this.module;
+            const messageTable =
+                getMessageTable === undefined || sha1Multi === undefined
+                    ? null
+                    : new Uint32Array(this.HEAPU8.buffer, getMessageTable(), maxMessageCount * 2);
+            const messagePieceIndices: number[] = [];
+
+            const hashMessages = () => {
+                if (sha1Multi === undefined || messagePieceIndices.length === 0) {
+                    return;
+                }
+
+                const resultPtr = sha1Multi(messagePieceIndices.length);
+                for (let i = 0; i < messagePieceIndices.length; ++i) {
+                    const hashPtr = resultPtr + i * hashResultSize;
+                    result.set(
+                        this.HEAPU8.subarray(hashPtr, hashPtr + hashResultSize),
+                        messagePieceIndices[i] * hashResultSize,
+                    );
+                }
+
+                messagePieceIndices.length = 0;
+            };
+
+            let segmentIndex = 0;
+            for (let i = 0; i < pieceSegmentCounts.length; ++i) {
+                const segmentCount = pieceSegmentCounts[i];
+
+                if (segmentCount === 1 && messageTable !== null) {
+                    const messageIndex = messagePieceIndices.length;
+                    const bufferIndex = segments[segmentIndex * 3];
+                    messageTable[messageIndex * 2] = bufferOffsets[bufferIndex] + segments[segmentIndex * 3 + 1];
+                    messageTable[messageIndex * 2 + 1] = segments[segmentIndex * 3 + 2];
+                    messagePieceIndices.push(i);
+
+                    if (isFused) {
+                        const offset = segments[segmentIndex * 3 + 1];
+                        const length = segments[segmentIndex * 3 + 2];
+                        zeroPieces[i] = isAllZero(buffers[bufferIndex].subarray(offset, offset + length)) ? 1 : 0;
+                    }
+
+                    ++segmentIndex;
+
+                    if (messagePieceIndices.length === maxMessageCount) {
+                        hashMessages();
+                    }
+
+                    continue;
+                }
+
+                for (let j = 0; j < segmentCount; ++j, ++segmentIndex) {
+                    const bufferIndex = segments[segmentIndex * 3];
+                    segmentTable[j * 2] = bufferOffsets[bufferIndex] + segments[segmentIndex * 3 + 1];
+                    segmentTable[j * 2 + 1] = segments[segmentIndex * 3 + 2];
+                }
+
+                if (isFused) {
+                    const resultPtr = sha1SegmentsFused(segmentCount, fusedDetectZero);
+                    result.set(this.HEAPU8.subarray(resultPtr, resultPtr + hashResultSize), i * hashResultSize);
+                    zeroPieces[i] = this.HEAPU8[resultPtr + hashResultSize] & fusedFlagAllZero ? 1 : 0;
+                    continue;
+                }
+
+                const resultPtr = sha1Segments(segmentCount);
+                result.set(this.HEAPU8.subarray(resultPtr, resultPtr + hashResultSize), i * hashResultSize);
+            }
+
+            hashMessages();
+        } else if (this.module.sha1SegmentsUpdate !== undefined) {
+            // The batch doesn't fit into the wasm memory (e.g. with 64MB pieces), the pieces are hashed one by one,
+            // in parts which fit
+            let segmentIndex = 0;
+            for (let i = 0; i < pieceSegmentCounts.length; ++i) {
+                const pieceParts: Uint8Array[] = [];
+                for (let j = 0; j < pieceSegmentCounts[i]; ++j, ++segmentIndex) {
+                    const buffer = buffers[segments[segmentIndex * 3]];
+                    const offset = segments[segmentIndex * 3 + 1];
+                    const length = segments[segmentIndex * 3 + 2];
+
+                    pieceParts.push(buffer.subarray(offset, offset + length));
+                }
+
+                result.set(this.computeStreamedHashWasm(pieceParts), i * hashResultSize);
+            }
+        } else {
+            // Copy the segments of each piece after each other, and hash them one by one
+            let segmentIndex = 0;
+            for (let i = 0; i < pieceSegmentCounts.length; ++i) {
+                let pieceLength = 0;
+                for (let j = 0; j < pieceSegmentCounts[i]; ++j, ++segmentIndex) {
+                    const buffer = buffers[segments[segmentIndex * 3]];
+                    const offset = segments[segmentIndex * 3 + 1];
+                    const length = segments[segmentIndex * 3 + 2];
+
+                    if (pieceLength + length > maxMessageSize) {
+                        throw Error("Pieces larger than 16MB are not supported by this build of the wasm module");
+                    }
+
+                    this.HEAPU8.set(buffer.subarray(offset, offset + length), ptr + pieceLength);
+                    pieceLength += length;
+                }
+
+                const resultPtr = this.module.sha1(pieceLength);
+                result.set(this.HEAPU8.subarray(resultPtr, resultPtr + hashResultSize), i * hashResultSize);
+            }
+        }
+
+        if (zeroPieces !== null && !isZeroDetectionDone) {
+            // Separate pass, when it can't be done together with the hashing
+            findZeroPieces(buffers, segments, pieceSegmentCounts, zeroPieces);
+        }
+
+        return result;
+    }
+
+    // Hashes the concatenation of the parts, without copying more than the size of the wasm memory buffer at once
+    // Used for messages which don't fit into the buffer, like 32MB and 64MB pieces
+    private computeStreamedHashWasm(parts: Uint8Array[]) {
+        this.beginStreamedHashWasm();
+        for (const part of parts) {
+            this.updateStreamedHashWasm(part);
+        }
+
+        return this.endStreamedHashWasm();
+    }
+
+    private getStreamingFunctions() {
+        const { getSegmentTable, sha1SegmentsBegin, sha1SegmentsUpdate, sha1SegmentsEnd } = this.module;
+        if (
+            getSegmentTable === undefined ||
+            sha1SegmentsBegin === undefined ||
+            sha1SegmentsUpdate === undefined ||
+            sha1SegmentsEnd === undefined
+        ) {
+            throw Error("Messages larger than 16MB are not supported by this build of the wasm module");
+        }
+
+        return { getSegmentTable, sha1SegmentsBegin, sha1SegmentsUpdate, sha1SegmentsEnd };
+    }
+
+    private beginStreamedHashWasm() {
+        this.getStreamingFunctions().sha1SegmentsBegin();
+        this.streamedBufferLength = 0;
+        this.streamedSegmentCount = 0;
+    }
+
+    // Hashes the data which is waiting in the wasm memory buffer
+    private flushStreamedHashWasm() {
+        this.getStreamingFunctions().sha1SegmentsUpdate(this.streamedSegmentCount);
+        this.streamedBufferLength = 0;
+        this.streamedSegmentCount = 0;
+    }
+
+    private updateStreamedHashWasm(part: Uint8Array) {
+        const ptr = this.module.getMemoryBuffer();
+        const segmentTable = new Uint32Array(
+            this.HEAPU8.buffer,
+            this.getStreamingFunctions().getSegmentTable(),
+            maxSegmentCount * 2,
+        );
+
+        let partOffset = 0;
+        while (partOffset < part.length) {
+            const length = Math.min(part.length - partOffset, maxSegmentBuffersSize - this.streamedBufferLength);
+            this.HEAPU8.set(part.subarray(partOffset, partOffset + length), ptr + this.streamedBufferLength);
+
+            segmentTable[this.streamedSegmentCount * 2] = this.streamedBufferLength;
+            segmentTable[this.streamedSegmentCount * 2 + 1] = length;
+            ++this.streamedSegmentCount;
+
+            this.streamedBufferLength += length;
+            partOffset += length;
+
+            if (this.streamedBufferLength === maxSegmentBuffersSize || this.streamedSegmentCount === maxSegmentCount) {
+                this.flushStreamedHashWasm();
+            }
+        }
+    }
+
+    private endStreamedHashWasm() {
+        this.flushStreamedHashWasm();
+
+        const resultPtr = this.getStreamingFunctions().sha1SegmentsEnd();
+        return this.HEAPU8.slice(resultPtr, resultPtr + hashResultSize);
+    }
+}
+
+// Checks 4 bytes at a time, the bytes before and after the aligned words one by one
+// Stops at the first non-zero word, so only pieces which are mostly zero are read completely
+// (BigUint64Array is not faster, since its values are compared as BigInts)
+function isAllZero(bytes: Uint8Array) {
+    const headLength = Math.min((4 - (bytes.byteOffset % 4)) % 4, bytes.length);
+    const wordCount = Math.floor((bytes.length - headLength) / 4);
+
+    for (let i = 0; i < headLength; ++i) {
+        if (bytes[i] !== 0) {
+            return false;
+        }
+    }
+
+    if (wordCount !== 0) {
+        const words = new Uint32Array(bytes.buffer, bytes.byteOffset + headLength, wordCount);
+        for (let i = 0; i < wordCount; ++i) {
+            if (words[i] !== 0) {
+                return false;
+            }
+        }
+    }
+
+    for (let i = headLength + wordCount * 4; i < bytes.length; ++i) {
+        if (bytes[i] !== 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Fallback of the zero detection of sha1SegmentsFused, for the other backends and older builds of the wasm module
+function findZeroPieces(
+    buffers: Uint8Array[],
+    segments: Uint32Array,
+    pieceSegmentCounts: Uint32Array,
+    zeroPieces: Uint8Array,
+) {
+    let segmentIndex = 0;
+    for (let i = 0; i < pieceSegmentCounts.length; ++i) {
+        let isPieceAllZero = true;
+        for (let j = 0; j < pieceSegmentCounts[i]; ++j, ++segmentIndex) {
+            const buffer = buffers[segments[segmentIndex * 3]];
+            const offset = segments[segmentIndex * 3 + 1];
+            const length = segments[segmentIndex * 3 + 2];
+
+            isPieceAllZero = isPieceAllZero && isAllZero(buffer.subarray(offset, offset + length));
+        }
+
+        zeroPieces[i] = isPieceAllZero ? 1 : 0;
+    }
+}
+
+function isSubtleCryptoAvailable() {
+    // Only available in secure contexts
+    return typeof crypto !== "undefined" && crypto.subtle !== undefined;
 }
 
 SetWorkerObject<Sha1WorkerObject, Uint8Array>(async initData => {
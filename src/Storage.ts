@@ -0,0 +1,67 @@
+/**
+Promise based helpers for the IndexedDB database, which is used to persist data between sessions
+
+Persistence is optional: if IndexedDB is not available (e.g. it's disabled by the browser),
+then {@link openDatabase} returns null, and everything should work without it
+*/
+
+const databaseName = "torrent-creator";
+const databaseVersion = 2;
+
+export const enum StoreName {
+    // Hashing progress of the last runs, the key is the job key
+    Checkpoints = "checkpoints",
+    // Piece hashes of the checkpoints, the key is [job key, start piece index]
+    CheckpointPieces = "checkpointPieces",
+    // Piece hashes of individual files, see PieceHashCache.ts
+    PieceHashes = "pieceHashes",
+}
+
+export const pieceHashesLastUsedIndex = "lastUsed";
+
+let databasePromise: Promise<IDBDatabase | null> | null = null;
+
+export function openDatabase() {
+    databasePromise ??= new Promise<IDBDatabase | null>(resolve => {
+        try {
+            const request = indexedDB.open(databaseName, databaseVersion);
+
+            request.onupgradeneeded = () => {
+                const db = request.result;
+                for (const storeName of [StoreName.Checkpoints, StoreName.CheckpointPieces]) {
+                    if (!db.objectStoreNames.contains(storeName)) {
+                        db.createObjectStore(storeName);
+                    }
+                }
+
+                if (!db.objectStoreNames.contains(StoreName.PieceHashes)) {
+                    const store = db.createObjectStore(StoreName.PieceHashes);
+                    store.createIndex(pieceHashesLastUsedIndex, "lastUsed");
+                }
+            };
+
+            request.onsuccess = () => resolve(request.result);
+            request.onerror = () => resolve(null);
+            request.onblocked = () => resolve(null);
+        } catch {
+            resolve(null);
+        }
+    });
+
+    return databasePromise;
+}
+
+export function requestToPromise<T>(request: IDBRequest<T>) {
+    return new Promise<T>((resolve, reject) => {
+        request.onsuccess = () => resolve(request.result);
+        request.onerror = () => reject(request.error);
+    });
+}
+
+export function transactionToPromise(transaction: IDBTransaction) {
+    return new Promise<void>((resolve, reject) => {
+        transaction.oncomplete = () => resolve();
+        transaction.onerror = () => reject(transaction.error);
+        transaction.onabort = () => reject(transaction.error);
+    });
+}
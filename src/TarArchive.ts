@@ -0,0 +1,257 @@
+/**
+Reads the list of members from a tar archive, without extracting it
+
+The data of each member is referenced with {@link Blob.slice}, so the member files can be hashed directly from the archive
+Supports ustar, GNU (long names, base-256 sizes) and pax (path and size records) archives
+*/
+
+import type { FileWithRelativePath } from "./FileInput";
+import { MB, Result } from "./Util";
+
+const tarBlockSize = 512;
+
+// Headers are read in larger windows, so archives with many small members don't need a separate read for each header
+const headerWindowSize = 1 * MB;
+
+const textDecoder = new TextDecoder();
+
+// Reads small parts of an archive (e.g. headers), see headerWindowSize
+export class ArchiveHeaderReader {
+    private archive: Blob;
+    private window = new Uint8Array();
+    private windowOffset = 0;
+
+    constructor(archive: Blob) {
+        this.archive = archive;
+    }
+
+    public async read(offset: number, length: number) {
+        if (offset < this.windowOffset || offset + length > this.windowOffset + this.window.length) {
+            const end = Math.min(offset + Math.max(length, headerWindowSize), this.archive.size);
+            this.window = new Uint8Array(await this.archive.slice(offset, end).arrayBuffer());
+            this.windowOffset = offset;
+        }
+
+        const start = offset - this.windowOffset;
+        return this.window.subarray(start, start + length);
+    }
+}
+
+function readString(header: Uint8Array, offset: number, length: number) {
+    const field = header.subarray(offset, offset + length);
+    const end = field.indexOf(0);
+    return textDecoder.decode(end === -1 ? field : field.subarray(0, end));
+}
+
+function readNumber(header: Uint8Array, offset: number, length: number) {
+    const field = header.subarray(offset, offset + length);
+
+    if ((field[0] & 0x80) !== 0) {
+        // GNU base-256 encoding, used for values which don't fit into the octal field (e.g. files larger than 8 GB)
+        let value = field[0] & 0x7f;
+        for (let i = 1; i < field.length; ++i) {
+            value = value * 256 + field[i];
+        }
+
+        return value;
+    }
+
+    const text = readString(header, offset, length).trim();
+    return text.length === 0 ? 0 : parseInt(text, 8);
+}
+
+function isValidChecksum(header: Uint8Array) {
+    // The checksum is calculated with the checksum field itself filled with spaces
+    let sum = 0;
+    for (let i = 0; i < tarBlockSize; ++i) {
+        sum += i >= 148 && i < 156 ? 0x20 : header[i];
+    }
+
+    return sum === readNumber(header, 148, 8);
+}
+
+function parsePaxRecords(data: Uint8Array) {
+    // Each record is formatted as "<length> <key>=<value>\n", where the length includes the whole record
+    const records = new Map<string, string>();
+
+    let offset = 0;
+    while (offset < data.length) {
+        const spaceIndex = data.indexOf(0x20, offset);
+        if (spaceIndex === -1) {
+            break;
+        }
+
+        const recordLength = parseInt(textDecoder.decode(data.subarray(offset, spaceIndex)), 10);
+        if (!(recordLength > 0)) {
+            break;
+        }
+
+        const record = textDecoder.decode(data.subarray(spaceIndex + 1, offset + recordLength - 1));
+        const equalsIndex = record.indexOf("=");
+        if (equalsIndex !== -1) {
+            records.set(record.substring(0, equalsIndex), record.substring(equalsIndex + 1));
+        }
+
+        offset += recordLength;
+    }
+
+    return records;
+}
+
+export function normalizePath(path: string): string[] | null {
+    const segments: string[] = [];
+    for (const segment of path.split("/")) {
+        if (segment === "" || segment === ".") {
+            continue;
+        }
+
+        if (segment === "..") {
+            return null;
+        }
+
+        segments.push(segment);
+    }
+
+    return segments;
+}
+
+function getArchiveBaseName(archiveName: string) {
+    const match = archiveName.match(/^(.+?)\.tar$/i);
+    return match === null ? archiveName : match[1];
+}
+
+interface TarMember {
+    path: string[];
+    dataOffset: number;
+    size: number;
+    lastModified: number;
+}
+
+export async function readTarEntries(archive: File): Promise<Result<FileWithRelativePath[], string>> {
+    const reader = new ArchiveHeaderReader(archive);
+
+    const members = new Map<string, TarMember>();
+
+    // Values from pax and GNU extension headers, which apply to the next member only
+    let nextPath: string | null = null;
+    let nextLinkPath: string | null = null;
+    let nextSize: number | null = null;
+
+    let offset = 0;
+    while (offset + tarBlockSize <= archive.size) {
+        const header = await reader.read(offset, tarBlockSize);
+
+        if (header.every(byte => byte === 0)) {
+            // End of archive
+            break;
+        }
+
+        if (!isValidChecksum(header)) {
+            return Result.error(`Invalid tar header at offset ${offset}, the archive might be damaged`);
+        }
+
+        const typeFlag = String.fromCharCode(header[156]);
+        const isExtensionHeader = typeFlag === "x" || typeFlag === "L" || typeFlag === "K";
+        const headerSize = readNumber(header, 124, 12);
+        const size = isExtensionHeader ? headerSize : (nextSize ?? headerSize);
+        const dataOffset = offset + tarBlockSize;
+        const dataBlockCount = Math.ceil(size / tarBlockSize);
+
+        if (dataOffset + size > archive.size) {
+            return Result.error("The tar archive is truncated");
+        }
+
+        offset = dataOffset + dataBlockCount * tarBlockSize;
+
+        if (isExtensionHeader) {
+            const data = await reader.read(dataOffset, size);
+
+            if (typeFlag === "x") {
+                const records = parsePaxRecords(data);
+
+                nextPath = records.get("path") ?? nextPath;
+                nextLinkPath = records.get("linkpath") ?? nextLinkPath;
+
+                const paxSize = records.get("size");
+                if (paxSize !== undefined) {
+                    nextSize = parseInt(paxSize, 10);
+                }
+            } else if (typeFlag === "L") {
+                nextPath = readString(data, 0, data.length);
+            } else {
+                nextLinkPath = readString(data, 0, data.length);
+            }
+
+            continue;
+        }
+
+        let pathText = nextPath;
+        if (pathText === null) {
+            pathText = readString(header, 0, 100);
+
+            const magic = readString(header, 257, 6);
+            const prefix = magic === "ustar" ? readString(header, 345, 155) : "";
+            if (prefix.length !== 0) {
+                pathText = prefix + "/" + pathText;
+            }
+        }
+
+        const linkPathText = nextLinkPath ?? readString(header, 157, 100);
+
+        nextPath = null;
+        nextLinkPath = null;
+        nextSize = null;
+
+        const path = normalizePath(pathText);
+        if (path === null) {
+            return Result.error(`Unsupported path in the tar archive: \`${pathText}\``);
+        }
+
+        const lastModified = readNumber(header, 136, 12) * 1000;
+
+        switch (typeFlag) {
+            case "0":
+            case "\0":
+            case "7": {
+                // Regular file (old archives mark directories with a trailing slash only)
+                if (path.length !== 0 && !pathText.endsWith("/")) {
+                    members.set(path.join("/"), { path, dataOffset, size, lastModified });
+                }
+                break;
+            }
+
+            case "1": {
+                // Hard link, the data is stored at the target member
+                const linkPath = normalizePath(linkPathText);
+                const target = linkPath === null ? undefined : members.get(linkPath.join("/"));
+                if (target === undefined) {
+                    return Result.error(`Hard link target not found in the tar archive: \`${linkPathText}\``);
+                }
+
+                members.set(path.join("/"), { ...target, path });
+                break;
+            }
+
+            case "S":
+                return Result.error(`Sparse files in tar archives are not supported: \`${pathText}\``);
+
+            default:
+                // Directories, symbolic links, devices, and unknown types don't have any file contents
+                break;
+        }
+    }
+
+    // If every member is in the same folder, then that folder is the root when extracted
+    // Otherwise, the members are placed in a folder with the same name as the archive
+    const memberList = [...members.values()];
+    const firstSegment = memberList.length === 0 ? null : memberList[0].path[0];
+    const hasCommonRoot = memberList.every(({ path }) => path.length > 1 && path[0] === firstSegment);
+    const rootPrefix = hasCommonRoot ? "" : getArchiveBaseName(archive.name) + "/";
+
+    return Result.ok(
+        memberList.map(({ path, dataOffset, size, lastModified }) => ({
+            relativePath: rootPrefix + path.join("/"),
+            file: new File([archive.slice(dataOffset, dataOffset + size)], path[path.length - 1], { lastModified }),
+        })),
+    );
+}
@@ -0,0 +1,378 @@
+/**
+Library interface of the torrent creator, for creating torrents in other web pages without the UI
+
+The files are given as an ordered list of sources, each source is a path, a length, and a `Blob` or a `ReadableStream`
+with the data. The files are hashed with the same worker pool and the same reads as in the app, and the progress is
+reported with an async iterator, which ends with the torrent file and its info hash:
+
+```ts
+for await (const event of createTorrentFromSources(sources, { name: "folder", signal })) {
+    if (event.type === "progress") {
+        console.log(event.bytesHashed / event.totalBytes);
+    } else {
+        console.log(event.infoHash, event.torrent);
+    }
+}
+```
+
+A single source with a path without folders creates a single-file torrent, otherwise the paths are relative to the
+folder of the torrent, and the files are in the torrent in the same order as the sources
+Streams are read once from the start, and they must be streams of `Uint8Array` chunks
+When the hashing stops early (abort, error, or breaking out of the loop), the streams are cancelled
+Like the HTTP sources, streams are read with BYOB readers, which are available in every recent browser
+Build with `npm run build:library`
+*/
+
+import {
+    createFolderStructure,
+    InputType,
+    type FileWithPath,
+    type FileWithRelativePath,
+    type SelectedFileOrFolderInfo,
+} from "./FileInput";
+import { ProgressiveInfoHash } from "./ProgressiveInfoHash";
+import { workerPoolPromise } from "./Sha1";
+import { createTorrentBlob } from "./TorrentFileOutput";
+import { assembleTorrentObject, calculateHashes, calculateInfoHash, getAutoBlockSize } from "./TorrentObject";
+import { BlockSize, type TorrentUIParameters } from "./UIState";
+import { KB, MB } from "./Util";
+
+export interface TorrentSource {
+    // Path of the file in the torrent, with `/` separators
+    path: string;
+    length: number;
+    data: Blob | ReadableStream<Uint8Array>;
+}
+
+export interface TorrentCreationOptions {
+    // Name of the torrent, and of its folder in multi-file torrents
+    // Required for multi-file torrents, single-file torrents use the file name by default
+    name?: string;
+    // Power of two between 16 KB and 64 MB, selected from the total size by default (at most 64 MB, or 16 MB if
+    // larger pieces are not supported)
+    // Pieces larger than 16 MB need a wasm module which can hash them in parts, or SubtleCrypto
+    pieceLength?: number;
+    trackers?: string[];
+    webSeeds?: string[];
+    comment?: string;
+    source?: string;
+    isPrivate?: boolean;
+    setCreationDate?: boolean;
+    // Stops the hashing and cancels the streams, the iterator throws the reason of the abort
+    signal?: AbortSignal;
+}
+
+export type TorrentCreationEvent =
+    | {
+          type: "progress";
+          bytesRead: number;
+          bytesHashed: number;
+          totalBytes: number;
+          currentFile: string;
+      }
+    | {
+          type: "done";
+          // The encoded .torrent file, the pieces are not copied into a separate buffer for it
+          torrent: Blob;
+          infoHash: string;
+      };
+
+// A stream as a file, which can be read once from the start
+// Only the parts of the `File` interface which are used for hashing are implemented (size, slice, and stream)
+class StreamFile {
+    public readonly name: string;
+    public readonly lastModified = 0;
+    public readonly webkitRelativePath = "";
+    public readonly size: number;
+
+    private source: ReadableStream<Uint8Array> | null;
+    private reader: ReadableStreamDefaultReader<Uint8Array> | null = null;
+    private isCancelled = false;
+
+    constructor(source: ReadableStream<Uint8Array>, name: string, size: number) {
+        this.source = source;
+        this.name = name;
+        this.size = size;
+    }
+
+    // Only the whole file can be read, a stream can't be read from the middle
+    public slice(start = 0, end = this.size) {
+        if (start !== 0 || end < this.size) {
+            throw Error(`Parts of a stream can't be read: \`${this.name}\``);
+        }
+
+        return this;
+    }
+
+    // Cancels the source, also while it's being read, so a pending read ends even if the source stalls
+    public cancel(reason: unknown) {
+        this.isCancelled = true;
+
+        (this.reader ?? this.source)?.cancel(reason).catch(() => {});
+        this.source = null;
+    }
+
+    // The chunks of the source are copied into the buffers of the reader, so the source keeps its buffers
+    public stream() {
+        if (this.isCancelled) {
+            throw Error(`Stream was cancelled: \`${this.name}\``);
+        }
+
+        if (this.source === null) {
+            throw Error(`Stream was already read: \`${this.name}\``);
+        }
+
+        const reader = this.source.getReader();
+        this.reader = reader;
+        this.source = null;
+
+        let chunk = new Uint8Array();
+        let bytesRead = 0;
+
+        return new ReadableStream({
+            type: "bytes",
+            pull: async controller => {
+                if (chunk.length === 0) {
+                    const result = await reader.read();
+                    if (this.isCancelled) {
+                        throw Error(`Stream was cancelled: \`${this.name}\``);
+                    }
+
+                    if (result.done) {
+                        if (bytesRead !== this.size) {
+                            throw Error(`Stream ended after ${bytesRead} of ${this.size} bytes: \`${this.name}\``);
+                        }
+
+                        controller.close();
+                        controller.byobRequest?.respond(0);
+                        return;
+                    }
+
+                    chunk = result.value;
+                    bytesRead += chunk.length;
+
+                    if (bytesRead > this.size) {
+                        throw Error(`Stream is longer than ${this.size} bytes: \`${this.name}\``);
+                    }
+                }
+
+                const view = controller.byobRequest?.view;
+                if (view === null || view === undefined) {
+                    controller.enqueue(chunk.slice());
+                    chunk = new Uint8Array();
+                    return;
+                }
+
+                const length = Math.min(chunk.length, view.byteLength);
+                new Uint8Array(view.buffer, view.byteOffset, length).set(chunk.subarray(0, length));
+                chunk = chunk.subarray(length);
+                controller.byobRequest!.respond(length);
+            },
+            cancel: reason => reader.cancel(reason),
+        });
+    }
+}
+
+function getSourceFile(source: TorrentSource, name: string) {
+    const { data, length } = source;
+
+    if (data instanceof Blob) {
+        if (data.size !== length) {
+            throw Error(`Size of \`${source.path}\` is ${data.size} bytes instead of ${length}`);
+        }
+
+        return data instanceof File ? data : new File([data], name);
+    }
+
+    return new StreamFile(data, name, length) as unknown as File;
+}
+
+// Creates the input in the same form as a selected file or folder in the app, with the files in the given order
+function getSourcesInfo(sources: TorrentSource[], name: string | undefined): SelectedFileOrFolderInfo {
+    if (sources.length === 0) {
+        throw Error("No sources were given");
+    }
+
+    const fileList: FileWithPath[] = [];
+    let totalSize = 0;
+
+    for (const source of sources) {
+        const path = source.path.split("/");
+        if (path.some(segment => segment.length === 0 || segment === "." || segment === "..")) {
+            throw Error(`Invalid path: \`${source.path}\``);
+        }
+
+        if (!Number.isSafeInteger(source.length) || source.length < 0) {
+            throw Error(`Invalid length of \`${source.path}\`: ${source.length}`);
+        }
+
+        fileList.push({ path, file: getSourceFile(source, path[path.length - 1]) });
+        totalSize += source.length;
+    }
+
+    if (fileList.length === 1 && fileList[0].path.length === 1) {
+        const { file } = fileList[0];
+        return {
+            name: name ?? file.name,
+            size: totalSize,
+            input: { type: InputType.File, file },
+            fileList,
+        };
+    }
+
+    // The folder structure is not used for creating the torrent, but it's part of the input
+    const rootName = name ?? "";
+    const entries: FileWithRelativePath[] = fileList.map(({ path, file }) => ({
+        relativePath: [rootName, ...path].join("/"),
+        file,
+    }));
+
+    return {
+        name: rootName,
+        size: totalSize,
+        input: { type: InputType.Folder, rootFolder: createFolderStructure(entries) },
+        fileList,
+    };
+}
+
+function getPieceLength(pieceLength: number | undefined, totalSize: number, canHashLargePieces: boolean) {
+    if (pieceLength === undefined) {
+        return getAutoBlockSize(totalSize, canHashLargePieces);
+    }
+
+    const isPowerOfTwo = Number.isInteger(pieceLength) && (pieceLength & (pieceLength - 1)) === 0;
+    if (!isPowerOfTwo || pieceLength < 16 * KB || pieceLength > 64 * MB) {
+        throw Error(`Invalid piece length: ${pieceLength}`);
+    }
+
+    return pieceLength;
+}
+
+// Creates a torrent from the sources, see the description at the top
+// Breaking out of the loop stops the hashing
+export async function* createTorrentFromSources(
+    sources: TorrentSource[],
+    options: TorrentCreationOptions = {},
+): AsyncGenerator<TorrentCreationEvent, void, undefined> {
+    const { signal } = options;
+    signal?.throwIfAborted();
+
+    const sourcesInfo = getSourcesInfo(sources, options.name);
+    const totalSize = sourcesInfo.size;
+
+    const workerPool = await workerPoolPromise;
+    const blockSize = getPieceLength(options.pieceLength, totalSize, workerPool.canHashLargePieces);
+    if (blockSize > 16 * MB && !workerPool.canHashLargePieces) {
+        throw Error(`Piece length ${blockSize} is not supported in this browser, the maximum is ${16 * MB}`);
+    }
+
+    const parameters: TorrentUIParameters = {
+        name: sourcesInfo.name,
+        blockSize: BlockSize.Auto, // Not used, the block size is given separately
+        isPrivate: options.isPrivate ?? false,
+        setCreationDate: options.setCreationDate ?? true,
+        trackers: (options.trackers ?? []).join("\n"),
+        webSeeds: (options.webSeeds ?? []).join("\n"),
+        comment: options.comment ?? "",
+        source: options.source ?? "",
+        variants: "",
+        createSubfolderTorrents: false,
+        detectZeroPieces: false,
+    };
+
+    const torrentObjectResult = assembleTorrentObject(parameters, sourcesInfo, blockSize).getData();
+    if (torrentObjectResult.isError) {
+        throw Error(torrentObjectResult.error);
+    }
+
+    const torrentObject = torrentObjectResult.result;
+    const infoHash = ProgressiveInfoHash.start(torrentObject.info, Math.ceil(totalSize / blockSize));
+
+    const runId = workerPool.beginRun();
+
+    // A stalled read of a stream would never end, so the streams are cancelled when the hashing stops
+    const streamFiles = sourcesInfo.fileList.flatMap(({ file }) => (file instanceof StreamFile ? [file] : []));
+
+    let isStopped = false;
+    const stop = () => {
+        isStopped = true;
+        workerPool.endRun(runId);
+
+        for (const file of streamFiles) {
+            file.cancel(signal?.reason);
+        }
+    };
+
+    // Progress is only kept until the next event is taken, so a slow consumer doesn't slow down the hashing
+    const progress = { bytesRead: 0, bytesHashed: 0, currentFile: "" };
+    let hasNewProgress = false;
+    let isFinished = false;
+    let wakeUp: (() => void) | null = null;
+
+    const onProgress = () => {
+        hasNewProgress = true;
+        wakeUp?.();
+        wakeUp = null;
+    };
+
+    signal?.addEventListener("abort", stop);
+
+    try {
+        const hashing = calculateHashes(
+            sourcesInfo.fileList,
+            totalSize,
+            blockSize,
+            runId,
+            // Any other id stops the run
+            () => (isStopped || signal?.aborted ? 0 : runId),
+            numBytes => {
+                progress.bytesRead += numBytes;
+                onProgress();
+            },
+            numBytes => {
+                progress.bytesHashed += numBytes;
+                onProgress();
+            },
+            filePath => {
+                progress.currentFile = filePath;
+                onProgress();
+            },
+            { infoHash },
+        ).finally(() => {
+            isFinished = true;
+            onProgress();
+        });
+
+        while (!isFinished) {
+            if (!hasNewProgress) {
+                await new Promise<void>(resolve => (wakeUp = resolve));
+            }
+
+            hasNewProgress = false;
+            if (!isFinished) {
+                yield { type: "progress", ...progress, totalBytes: totalSize };
+            }
+        }
+
+        const hashingResult = (await hashing).getData();
+        signal?.throwIfAborted();
+
+        if (hashingResult.isError) {
+            throw Error(hashingResult.error ?? "Hashing was cancelled");
+        }
+
+        torrentObject.info.pieces = hashingResult.result;
+
+        yield { type: "progress", ...progress, totalBytes: totalSize };
+        yield {
+            type: "done",
+            torrent: await createTorrentBlob(torrentObject),
+            infoHash: await calculateInfoHash(torrentObject.info),
+        };
+    } finally {
+        signal?.removeEventListener("abort", stop);
+
+        // Also when the consumer stopped the loop early
+        stop();
+    }
+}
@@ -0,0 +1,126 @@
+/**
+Outputs of an encoded torrent file, which don't copy the whole file into a single buffer
+
+The pieces of a torrent are the largest part of its data, and the bencoded torrent only references them (see
+{@link BencodeBuffer.getChunks}), so the file can be written, downloaded or hashed without making another copy of them
+When the File System Access API is available, the torrent file is written directly into the selected file
+*/
+
+import { BencodeBuffer } from "./Bencode";
+import { createTorrentModel } from "./ParallelEncoding";
+import { workerPoolPromise } from "./Sha1";
+import type { TorrentObject } from "./TorrentObject";
+import { MB } from "./Util";
+
+// Size of the parts which are written to the file, and sent to a worker for hashing
+const outputPartSize = 4 * MB;
+
+interface SaveFileHandle {
+    createWritable: () => Promise<WritableStream<Uint8Array>>;
+}
+
+// Not available in every browser, and it's not in the type definitions yet
+declare global {
+    interface Window {
+        showSaveFilePicker?: (options?: {
+            suggestedName?: string;
+            types?: { description: string; accept: Record<string, string[]> }[];
+        }) => Promise<SaveFileHandle>;
+    }
+}
+
+// Copies the chunks into parts of at most outputPartSize bytes: small chunks are merged, and large chunks are split
+// The parts are new buffers, so they can be transferred to a worker without detaching the original data
+export function* getOutputParts(chunks: readonly Uint8Array[]) {
+    let remainingLength = chunks.reduce((length, chunk) => length + chunk.length, 0);
+
+    let part = new Uint8Array(Math.min(remainingLength, outputPartSize));
+    let partLength = 0;
+
+    for (const chunk of chunks) {
+        let chunkOffset = 0;
+        while (chunkOffset < chunk.length) {
+            const length = Math.min(chunk.length - chunkOffset, part.length - partLength);
+            part.set(chunk.subarray(chunkOffset, chunkOffset + length), partLength);
+
+            partLength += length;
+            chunkOffset += length;
+            remainingLength -= length;
+
+            if (partLength === part.length) {
+                yield part;
+
+                part = new Uint8Array(Math.min(remainingLength, outputPartSize));
+                partLength = 0;
+            }
+        }
+    }
+}
+
+export async function calculatePartsHash(parts: Iterable<Uint8Array> | AsyncIterable<Uint8Array>) {
+    const workerPool = await workerPoolPromise;
+    const hash = await workerPool.computeStreamedHash(parts);
+
+    if (hash === null) {
+        // Shouldn't happen, this is not cancelable
+        throw Error("Calculation was cancelled");
+    }
+
+    return [...hash].map(byte => byte.toString(16).padStart(2, "0")).join("");
+}
+
+// Calculates the sha-1 hash of the encoded data in parts, without copying all of it into a single buffer
+export function calculateEncodedHash(buffer: BencodeBuffer) {
+    return calculatePartsHash(getOutputParts(buffer.getChunks()));
+}
+
+export async function createTorrentBlob(torrentObject: TorrentObject) {
+    const chunks = createTorrentModel(torrentObject).encode(new BencodeBuffer()).getChunks();
+    return new Blob(chunks as Uint8Array<ArrayBuffer>[], { type: "application/octet-stream" });
+}
+
+// Writes the torrent file into the stream
+// The info hash is not calculated here, the callers already have it from the creation of the torrent
+export async function writeTorrentFile(torrentObject: TorrentObject, stream: WritableStream<Uint8Array>) {
+    const chunks = createTorrentModel(torrentObject).encode(new BencodeBuffer()).getChunks();
+
+    const writer = stream.getWriter();
+
+    try {
+        for (const part of getOutputParts(chunks)) {
+            await writer.write(part);
+        }
+
+        await writer.close();
+    } catch (ex) {
+        // Discards the partially written file
+        await writer.abort(ex).catch(() => {});
+        throw ex;
+    }
+}
+
+export function canSaveTorrentFile() {
+    return typeof window.showSaveFilePicker === "function";
+}
+
+// Asks where to save the torrent file, and writes it there
+// Returns false if no file was selected
+export async function saveTorrentFile(torrentObject: TorrentObject, fileName = torrentObject.info.name + ".torrent") {
+    if (window.showSaveFilePicker === undefined) {
+        throw Error("Saving files is not supported");
+    }
+
+    let handle: SaveFileHandle;
+    try {
+        handle = await window.showSaveFilePicker({
+            suggestedName: fileName,
+            types: [{ description: "Torrent file", accept: { "application/x-bittorrent": [".torrent"] } }],
+        });
+    } catch {
+        // Cancelled
+        return false;
+    }
+
+    await writeTorrentFile(torrentObject, await handle.createWritable());
+    return true;
+}
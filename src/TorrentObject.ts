@@ -1,6 +1,12 @@
 import { BencodeBuffer, BencodeDict } from "./Bencode";
 import { InputType, type FileWithPath, type SelectedFileOrFolderInfo } from "./FileInput";
+import type { HashCheckpoint } from "./HashCheckpoint";
+import type { HashingMetrics } from "./HashingMetrics";
+import { calculateInfoHashParallel, minParallelFileCount } from "./ParallelEncoding";
+import { getFullPieceRange, type PieceHashCache } from "./PieceHashCache";
+import { getProgressiveInfoHash, type ProgressiveInfoHash } from "./ProgressiveInfoHash";
 import { workerPoolPromise } from "./Sha1";
+import { calculateEncodedHash } from "./TorrentFileOutput";
 import { BlockSize, type TorrentUIParameters } from "./UIState";
 import { getLines, KB, MB, Result } from "./Util";
 
@@ -29,7 +35,11 @@ export type TorrentObject = {
     comment?: string;
 };
 
-export function validateTorrentInput(torrentUIParameters: TorrentUIParameters): Result<null, string> {
+// Pieces larger than 16MB are rejected if the worker pool can't hash them (see canHashLargePieces in Sha1.ts)
+export function validateTorrentInput(
+    torrentUIParameters: TorrentUIParameters,
+    canHashLargePieces = true,
+): Result<null, string> {
     if (torrentUIParameters.name.length === 0) {
         return Result.error("Torrent name cannot be empty");
     }
@@ -64,9 +74,110 @@ export function validateTorrentInput(torrentUIParameters: TorrentUIParameters):
         }
     }
 
+    const { blockSize } = torrentUIParameters;
+    if (!canHashLargePieces && (blockSize === BlockSize.MB32 || blockSize === BlockSize.MB64)) {
+        return Result.error("Block sizes larger than 16 MB are not supported in this browser");
+    }
+
+    const variantsError = parseTorrentVariants(torrentUIParameters.variants).getError();
+    if (variantsError !== null) {
+        return Result.error(variantsError);
+    }
+
     return Result.ok(null);
 }
 
+export interface TorrentVariant {
+    // Used in the file name of the variant
+    label: string;
+    source?: string;
+    isPrivate?: boolean;
+    trackers?: string;
+}
+
+// Only used to validate the variants
+const emptyUIParameters: TorrentUIParameters = {
+    name: "variant",
+    blockSize: BlockSize.Auto,
+    isPrivate: false,
+    setCreationDate: false,
+    trackers: "",
+    webSeeds: "",
+    comment: "",
+    source: "",
+    variants: "",
+    createSubfolderTorrents: false,
+    detectZeroPieces: false,
+};
+
+/**
+Parses the variants, one per line, e.g. `source=ABC private https://tracker.example/announce`
+- `source=<value>` sets the source
+- `private` or `public` sets the private flag
+- every other word is a tracker
+
+Whatever is not set in a variant is the same as in the main torrent
+All variants have the same pieces as the main torrent, so they are created from a single hashing pass
+*/
+export function parseTorrentVariants(variantsText: string): Result<TorrentVariant[], string> {
+    const variants: TorrentVariant[] = [];
+
+    for (const line of variantsText.split("\n")) {
+        const words = getLines(line);
+        if (words.length === 0) {
+            continue;
+        }
+
+        const variant: TorrentVariant = {
+            label: `variant ${variants.length + 1}`,
+        };
+        const trackers: string[] = [];
+
+        for (const word of words) {
+            if (word === "private" || word === "public") {
+                variant.isPrivate = word === "private";
+            } else if (word.startsWith("source=")) {
+                variant.source = word.substring("source=".length);
+                if (variant.source !== "") {
+                    variant.label = variant.source;
+                }
+            } else {
+                trackers.push(word);
+            }
+        }
+
+        if (trackers.length !== 0) {
+            variant.trackers = trackers.join("\n");
+        }
+
+        variants.push(variant);
+    }
+
+    // Validate the trackers of the variants the same way as the trackers of the main torrent
+    for (const variant of variants) {
+        const error = validateTorrentInput(applyTorrentVariant(variant, emptyUIParameters)).getError();
+        if (error !== null) {
+            return Result.error(`Invalid variant \`${variant.label}\`: ${error}`);
+        }
+    }
+
+    return Result.ok(variants);
+}
+
+// Returns the parameters of the main torrent, overridden by the values of the variant
+export function applyTorrentVariant(
+    variant: TorrentVariant,
+    torrentUIParameters: TorrentUIParameters,
+): TorrentUIParameters {
+    return {
+        ...torrentUIParameters,
+        source: variant.source ?? torrentUIParameters.source,
+        isPrivate: variant.isPrivate ?? torrentUIParameters.isPrivate,
+        trackers: variant.trackers ?? torrentUIParameters.trackers,
+        variants: "",
+    };
+}
+
 export function assembleTorrentObject(
     torrentUIParameters: TorrentUIParameters,
     selectedFileOrFolderInfo: SelectedFileOrFolderInfo | null,
@@ -138,6 +249,96 @@ export function assembleTorrentObject(
     return Result.ok(torrentObject);
 }
 
+export interface HashingOptions {
+    // Saves the progress periodically, and continues from the saved progress of a previous run
+    checkpoint?: HashCheckpoint;
+    // Reuses the piece hashes of unchanged files from previous runs
+    pieceCache?: PieceHashCache;
+    // Collects statistics about the run
+    metrics?: HashingMetrics;
+    // Pieces of these subtrees are hashed from the same reads as the pieces of the whole torrent
+    // The checkpoint and the piece cache are not used in this case, since the skipped data would be missing here
+    subtrees?: SubtreeHashing[];
+    // Collects the indices of the pieces which contain only zero bytes (e.g. preallocated files which were never
+    // written), the check is done together with the hashing
+    // The checkpoint and the piece cache are not used in this case either, every piece has to be read to be checked
+    zeroPieceIndices?: number[];
+    // Calculates the info hash together with the pieces, the pieces are added to it as they are completed
+    infoHash?: ProgressiveInfoHash;
+}
+
+// A range of files, which is hashed as a separate torrent, see getSubfolders
+export interface SubtreeHashing {
+    firstFileIndex: number;
+    endFileIndex: number;
+    blockSize: number;
+    // Set by calculateHashes, if it succeeds
+    pieces?: Uint8Array;
+}
+
+// Segments of the pieces in the current batch
+interface PieceStream {
+    blockSize: number;
+    segments: number[]; // Buffer index, offset, and length of each segment
+    pieceSegmentCounts: number[];
+    lastPieceLength: number; // Number of bytes of the last piece of the batch so far
+}
+
+interface SubtreeStream extends PieceStream {
+    subtree: SubtreeHashing;
+    // Range of the subtree in the concatenated input files
+    startOffset: number;
+    endOffset: number;
+    pieces: Uint8Array;
+    pieceIndex: number;
+    // Bytes of the last piece of the previous batch, if that piece continues in the current batch
+    carry: Uint8Array | null;
+}
+
+function createPieceStream(blockSize: number): PieceStream {
+    return {
+        blockSize,
+        segments: [],
+        pieceSegmentCounts: [],
+        lastPieceLength: 0,
+    };
+}
+
+function addPieceSegments(stream: PieceStream, bufferIndex: number, offset: number, length: number) {
+    const { blockSize, segments, pieceSegmentCounts } = stream;
+
+    while (length !== 0) {
+        if (stream.lastPieceLength === 0) {
+            pieceSegmentCounts.push(0);
+        }
+
+        const segmentLength = Math.min(length, blockSize - stream.lastPieceLength);
+        const lastSegmentIndex = segments.length - 3;
+
+        if (
+            stream.lastPieceLength !== 0 &&
+            segments[lastSegmentIndex] === bufferIndex &&
+            segments[lastSegmentIndex + 1] + segments[lastSegmentIndex + 2] === offset
+        ) {
+            // Continues the previous segment in the same buffer (e.g. the next file was read into the same buffer)
+            segments[lastSegmentIndex + 2] += segmentLength;
+        } else {
+            segments.push(bufferIndex, offset, segmentLength);
+            ++pieceSegmentCounts[pieceSegmentCounts.length - 1];
+        }
+
+        stream.lastPieceLength = (stream.lastPieceLength + segmentLength) % blockSize;
+        offset += segmentLength;
+        length -= segmentLength;
+    }
+}
+
+const enum ReadStatus {
+    Done,
+    Error,
+    Cancelled,
+}
+
 export async function calculateHashes(
     inputFiles: FileWithPath[],
     totalSize: number,
@@ -147,51 +348,246 @@ export async function calculateHashes(
     updateReadingProgress: (progress: number) => void,
     updateProcessingProgress: (progress: number) => void,
     onReadingFileStarted: (filePath: string) => void,
+    options: HashingOptions = {},
 ): Promise<Result<Uint8Array, string | null>> {
-    const isCancelled = () => creationId !== getCurrentCreationId();
+    const { metrics, subtrees = [], zeroPieceIndices, infoHash } = options;
+    // Skipping data is not possible if every piece needs to be read
+    const canSkipPieces = subtrees.length === 0 && zeroPieceIndices === undefined;
+    const checkpoint = canSkipPieces ? (options.checkpoint ?? null) : null;
+    const pieceCache = canSkipPieces ? (options.pieceCache ?? null) : null;
+
+    let isCancellationHandled = false;
+    const isCancelled = () => {
+        if (creationId === getCurrentCreationId()) {
+            return false;
+        }
+
+        // Keep the progress, so the run can be continued later
+        // Only saved once, this is checked for every chunk and batch after the run is cancelled
+        if (!isCancellationHandled) {
+            isCancellationHandled = true;
+            checkpoint?.save();
+        }
+
+        return true;
+    };
 
     const totalBlockCount = Math.ceil(totalSize / blockSize);
     const piecesLocal = new Uint8Array(totalBlockCount * 20); // 20 bytes per sha-1 hash
     let pieceIndex = 0;
 
+    // Continue from a previous run, if possible
+    let resumePieceCount = 0;
+    let resumeByteOffset = 0;
+    if (checkpoint !== null) {
+        piecesLocal.set(checkpoint.resumePieces);
+        resumePieceCount = checkpoint.resumePieceCount;
+        pieceIndex = resumePieceCount;
+        resumeByteOffset = Math.min(pieceIndex * blockSize, totalSize);
+
+        checkpoint.start(piecesLocal);
+        infoHash?.onPiecesCompleted(piecesLocal, 0, resumePieceCount);
+
+        if (metrics !== undefined) {
+            metrics.resumedBytes = resumeByteOffset;
+        }
+
+        updateReadingProgress(resumeByteOffset);
+        updateProcessingProgress(resumeByteOffset);
+    }
+
+    const cachedFilePieces =
+        pieceCache === null ? inputFiles.map(() => null) : await pieceCache.lookup(inputFiles, blockSize);
+
     const workerPool = await workerPoolPromise;
+    const backend = await workerPool.selectBackend(blockSize);
+
+    if (metrics !== undefined) {
+        metrics.kernel = workerPool.getKernel(backend);
+        metrics.workerCount = workerPool.workerCount;
+    }
 
     const allWorkerPromises: Promise<void>[] = [];
 
-    const memoryPool: Uint8Array[] = [];
+    const hasBYOB = File.prototype.stream !== undefined && typeof ReadableStreamBYOBReader !== undefined;
 
-    function dispatchSha1Worker(inputBytes: Uint8Array) {
-        const inputLength = inputBytes.length;
-        const numPieces = Math.ceil(inputLength / blockSize);
+    // The data is hashed in batches of 16MB, even for lower block sizes
+    // Larger pieces (32MB and 64MB) are hashed in batches of one piece, the workers hash them in parts
+    // A batch is a list of buffers, and each piece is a list of segments of these buffers, so pieces which span
+    // multiple files or reads can be hashed without copying them into a contiguous buffer first
+    // With stream-based reading, the data is read directly into a single buffer for each batch, which is reused
+    const batchSize = Math.max(16 * MB, blockSize);
+    const batchBufferPool: ArrayBuffer[] = [];
+
+    let batchBuffers: Uint8Array[] = [];
+    let batchLength = 0;
+    let batchStream = createPieceStream(blockSize);
+
+    // Position of the next byte to be read, in the concatenated input files
+    let readOffset = 0;
+
+    // The subtrees have their own pieces, which are hashed in the same batches as the pieces of the whole torrent
+    // Their pieces are not aligned to the batches, so a piece which continues in the next batch is copied, and hashed
+    // with the next batch
+    const subtreeStreams: SubtreeStream[] = [];
+    {
+        const fileOffsets = [0];
+        for (const { file } of inputFiles) {
+            fileOffsets.push(fileOffsets[fileOffsets.length - 1] + file.size);
+        }
 
-        const startPieceIndex = pieceIndex;
-        pieceIndex += numPieces;
+        for (const subtree of subtrees) {
+            const startOffset = fileOffsets[subtree.firstFileIndex];
+            const endOffset = fileOffsets[subtree.endFileIndex];
+
+            subtreeStreams.push({
+                ...createPieceStream(subtree.blockSize),
+                subtree,
+                startOffset,
+                endOffset,
+                pieces: new Uint8Array(Math.ceil((endOffset - startOffset) / subtree.blockSize) * 20),
+                pieceIndex: 0,
+                carry: null,
+            });
+        }
+    }
+
+    function addSubtreeSegments(bufferIndex: number, offset: number, length: number) {
+        for (const stream of subtreeStreams) {
+            const startOffset = Math.max(stream.startOffset, readOffset);
+            const endOffset = Math.min(stream.endOffset, readOffset + length);
+
+            if (startOffset >= endOffset) {
+                continue;
+            }
+
+            if (stream.carry !== null) {
+                batchBuffers.push(stream.carry);
+                addPieceSegments(stream, batchBuffers.length - 1, 0, stream.carry.length);
+                stream.carry = null;
+            }
+
+            addPieceSegments(stream, bufferIndex, offset + startOffset - readOffset, endOffset - startOffset);
+
+            if (endOffset === stream.endOffset) {
+                // The last piece of the subtree is complete, even if it's shorter than the block size
+                stream.lastPieceLength = 0;
+            }
+        }
+    }
+
+    // Copies the bytes of the last piece of the subtree, if it continues in the next batch
+    function carrySubtreePiece(stream: SubtreeStream) {
+        if (stream.lastPieceLength === 0) {
+            return;
+        }
+
+        const segmentCount = stream.pieceSegmentCounts.pop()!;
+        const segments = stream.segments.splice(stream.segments.length - segmentCount * 3);
+
+        const carry = new Uint8Array(stream.lastPieceLength);
+        let carryLength = 0;
+        for (let i = 0; i < segments.length; i += 3) {
+            const [bufferIndex, offset, length] = segments.slice(i, i + 3);
+            carry.set(batchBuffers[bufferIndex].subarray(offset, offset + length), carryLength);
+            carryLength += length;
+        }
+
+        stream.carry = carry;
+        stream.lastPieceLength = 0;
+    }
+
+    function dispatchBatch() {
+        if (batchLength === 0) {
+            return;
+        }
+
+        const numPieces = batchStream.pieceSegmentCounts.length;
 
-        const inputs: Uint8Array[] = [];
-        for (let i = 0; i < numPieces; ++i) {
-            const startByteIndex = i * blockSize;
-            const endByteIndex = Math.min((i + 1) * blockSize, inputLength);
+        // The pieces of the subtrees are hashed after the pieces of the whole torrent, in the same call
+        const allSegments = batchStream.segments;
+        const allPieceSegmentCounts = batchStream.pieceSegmentCounts;
+        const subtreePieceRanges: { stream: SubtreeStream; startPieceIndex: number; pieceCount: number }[] = [];
 
-            const byteLength = endByteIndex - startByteIndex;
-            const memoryBuffer = (memoryPool.pop() ?? new Uint8Array(blockSize)).subarray(0, byteLength);
-            memoryBuffer.set(inputBytes.subarray(startByteIndex, endByteIndex));
+        for (const stream of subtreeStreams) {
+            carrySubtreePiece(stream);
 
-            inputs.push(memoryBuffer);
+            const pieceCount = stream.pieceSegmentCounts.length;
+            if (pieceCount !== 0) {
+                allSegments.push(...stream.segments);
+                allPieceSegmentCounts.push(...stream.pieceSegmentCounts);
+                subtreePieceRanges.push({ stream, startPieceIndex: stream.pieceIndex, pieceCount });
+
+                stream.pieceIndex += pieceCount;
+                stream.segments = [];
+                stream.pieceSegmentCounts = [];
+            }
         }
 
+        const buffers = batchBuffers;
+        const segments = new Uint32Array(allSegments);
+        const pieceSegmentCounts = new Uint32Array(allPieceSegmentCounts);
+        const inputLength = batchLength;
+
+        const startPieceIndex = pieceIndex;
+        pieceIndex += numPieces;
+
+        batchBuffers = [];
+        batchLength = 0;
+        batchStream = createPieceStream(blockSize);
+
+        metrics?.onBatchDispatched();
+
         async function calculateHashes() {
-            const hashResult = await workerPool.computeHashes(inputs, creationId);
+            const hashResult = await workerPool.computeSegmentHashes(
+                buffers,
+                segments,
+                pieceSegmentCounts,
+                creationId,
+                metrics,
+                { detectZeroPieces: zeroPieceIndices !== undefined },
+                backend,
+            );
+
             if (hashResult === null) {
                 // Cancelled
                 return;
             }
 
-            // Return reused buffers
-            memoryPool.push(...hashResult.originalInputs);
+            // Return the reused buffer
+            if (hasBYOB) {
+                batchBufferPool.push(hashResult.originalInputs[0].buffer as ArrayBuffer);
+            }
 
             // Copy results into the pieces list
             const pieceByteIndex = startPieceIndex * 20;
-            piecesLocal.set(hashResult.result, pieceByteIndex);
+            piecesLocal.set(hashResult.result.subarray(0, numPieces * 20), pieceByteIndex);
+
+            let resultByteIndex = numPieces * 20;
+            for (const { stream, startPieceIndex, pieceCount } of subtreePieceRanges) {
+                const resultByteCount = pieceCount * 20;
+                const resultPieces = hashResult.result.subarray(resultByteIndex, resultByteIndex + resultByteCount);
+                stream.pieces.set(resultPieces, startPieceIndex * 20);
+                resultByteIndex += resultByteCount;
+            }
+
+            // Only the pieces of the whole torrent, the subtrees have the same data
+            const { zeroPieces } = hashResult;
+            if (zeroPieceIndices !== undefined && zeroPieces !== null) {
+                for (let i = 0; i < numPieces; ++i) {
+                    if (zeroPieces[i] !== 0) {
+                        zeroPieceIndices.push(startPieceIndex + i);
+
+                        if (metrics !== undefined) {
+                            ++metrics.zeroPieces;
+                        }
+                    }
+                }
+            }
+
+            checkpoint?.onPiecesCompleted(startPieceIndex, numPieces);
+            infoHash?.onPiecesCompleted(piecesLocal, startPieceIndex, numPieces);
+            metrics?.onBatchCompleted(pieceSegmentCounts.length, inputLength);
 
             updateProcessingProgress(inputLength);
         }
@@ -199,83 +595,115 @@ export async function calculateHashes(
         allWorkerPromises.push(calculateHashes());
     }
 
-    // Read 16MB chunks, even for lower block sizes
-    const readBufferSize = 16 * MB;
-    const readAccumulatorBuffer = new Uint8Array(readBufferSize);
-    let readBufferIndex = 0;
+    // Returns the free part of the buffer of the current batch, the next chunk of data can be read into this
+    function getBatchReadTarget() {
+        if (batchBuffers.length === 0) {
+            batchBuffers.push(new Uint8Array(batchBufferPool.pop() ?? new ArrayBuffer(batchSize), 0, 0));
+        }
 
-    function onFileChunkRead(resultBytes: Uint8Array) {
+        return new Uint8Array(batchBuffers[0].buffer, batchLength, batchSize - batchLength);
+    }
+
+    function onFileChunkRead(resultBytes: Uint8Array, isReadIntoBatchBuffer: boolean) {
         if (isCancelled()) {
             return;
         }
 
         updateReadingProgress(resultBytes.length);
 
-        if (readBufferIndex + resultBytes.length >= readBufferSize) {
-            // Block is full
-            const remainingSize = readBufferSize - readBufferIndex;
+        if (metrics !== undefined) {
+            metrics.bytesRead += resultBytes.length;
+        }
 
-            readAccumulatorBuffer.set(resultBytes.subarray(0, remainingSize), readBufferIndex);
-            resultBytes = resultBytes.subarray(remainingSize);
+        let bufferIndex = 0;
+        if (isReadIntoBatchBuffer) {
+            // The buffer passed to the read is detached, and the same memory is returned in a new buffer
+            batchBuffers[0] = new Uint8Array(resultBytes.buffer, 0, resultBytes.byteOffset + resultBytes.length);
+        } else {
+            bufferIndex = batchBuffers.push(resultBytes) - 1;
+        }
 
-            // Send to worker (no await here, all work will be awaited at the end)
-            dispatchSha1Worker(readAccumulatorBuffer);
+        const offset = isReadIntoBatchBuffer ? resultBytes.byteOffset : 0;
+        addPieceSegments(batchStream, bufferIndex, offset, resultBytes.length);
+        addSubtreeSegments(bufferIndex, offset, resultBytes.length);
 
-            readBufferIndex = 0;
-        }
+        batchLength += resultBytes.length;
+        readOffset += resultBytes.length;
 
-        // The rest of the file fits into the read buffer
-        readAccumulatorBuffer.set(resultBytes, readBufferIndex);
-        readBufferIndex += resultBytes.length;
+        if (batchLength === batchSize) {
+            // Send to worker (no await here, all work will be awaited at the end)
+            dispatchBatch();
+        }
     }
 
-    const hasBYOB = File.prototype.stream !== undefined && typeof ReadableStreamBYOBReader !== undefined;
+    function skipCachedPieces(pieces: Uint8Array) {
+        // The batch ends at a piece boundary here, so it can be hashed without waiting for more data
+        dispatchBatch();
 
-    for (const { path, file } of inputFiles) {
-        if (file.size === 0) {
-            // Files with 0 size don't contribute to the final hash
-            continue;
+        const pieceCount = pieces.length / 20;
+        piecesLocal.set(pieces, pieceIndex * 20);
+        checkpoint?.onPiecesCompleted(pieceIndex, pieceCount);
+        infoHash?.onPiecesCompleted(piecesLocal, pieceIndex, pieceCount);
+        pieceIndex += pieceCount;
+
+        if (metrics !== undefined) {
+            metrics.cacheHitPieces += pieceCount;
+            metrics.cacheHitBytes += pieceCount * blockSize;
         }
 
-        const filePath = path.join("/");
-        onReadingFileStarted(filePath);
+        updateReadingProgress(pieceCount * blockSize);
+        updateProcessingProgress(pieceCount * blockSize);
+    }
 
-        function getError() {
-            return Result.error<Uint8Array, string>(
-                `Error reading file: \`${filePath}\`
-The file might be inaccessible, or might have been modified, moved, or deleted`,
-            );
+    // The exception of the last failed read, the sources with a custom stream() (e.g. HTTP and zip files) report
+    // their own errors with it
+    let readError: unknown = null;
+
+    async function readFileRange(file: File, startIndex: number, endIndex: number) {
+        if (startIndex >= endIndex) {
+            return ReadStatus.Done;
         }
 
+        const fileRange = startIndex === 0 && endIndex === file.size ? file : file.slice(startIndex, endIndex);
+
         if (hasBYOB) {
             // Faster, stream-based version
 
-            let byobBuffer = new ArrayBuffer(readBufferSize);
-
-            const stream = file.stream();
-            const reader = stream.getReader({ mode: "byob" });
+            let reader: ReadableStreamBYOBReader;
+            try {
+                reader = fileRange.stream().getReader({ mode: "byob" });
+            } catch (ex) {
+                readError = ex;
+                return ReadStatus.Error;
+            }
 
             while (true) {
+                const readTarget = getBatchReadTarget();
                 let readResult: ReadableStreamReadResult<Uint8Array<ArrayBuffer>>;
 
+                const readStartTime = performance.now();
                 try {
                     // @ts-expect-error
                     // https://developer.mozilla.org/en-US/docs/Web/API/ReadableStreamBYOBReader/read
                     // An optional `min` parameter is available in new browsers, which requests at least N bytes to be read
                     // But since this is very new, the type definitions are not updated yet
                     // Once they are updated, this comment can be removed
-                    readResult = await reader.read(new Uint8Array(byobBuffer), { min: readBufferSize });
-                } catch (_ex) {
-                    return getError();
+                    readResult = await reader.read(readTarget, { min: readTarget.length });
+                } catch (ex) {
+                    readError = ex;
+                    return ReadStatus.Error;
+                }
+
+                if (metrics !== undefined) {
+                    metrics.readWaitMs += performance.now() - readStartTime;
                 }
 
                 if (isCancelled()) {
-                    return Result.error(null);
+                    return ReadStatus.Cancelled;
                 }
 
                 if (readResult.value !== undefined) {
-                    byobBuffer = readResult.value.buffer;
-                    onFileChunkRead(readResult.value);
+                    onFileChunkRead(readResult.value, true);
                 }
 
                 if (readResult.done) {
@@ -296,39 +724,106 @@ The file might be inaccessible, or might have been modified, moved, or deleted`,
                     return;
                 }
 
-                onFileChunkRead(new Uint8Array(result));
+                onFileChunkRead(new Uint8Array(result), false);
                 resolver();
             };
 
             reader.onerror = onError;
 
-            const numReadsForCurrentFile = Math.ceil(file.size / readBufferSize);
-            for (let i = 0; i < numReadsForCurrentFile; ++i) {
-                const startIndex = i * readBufferSize;
-                const endIndex = Math.min((i + 1) * readBufferSize, file.size);
+            let chunkStartIndex = 0;
+            while (chunkStartIndex < fileRange.size) {
+                // Reads don't go over the end of the current batch
+                const chunkEndIndex = Math.min(chunkStartIndex + batchSize - batchLength, fileRange.size);
 
+                const readStartTime = performance.now();
                 try {
                     await new Promise<void>((resolve, reject) => {
                         resolver = resolve;
                         onError = reject;
-                        reader.readAsArrayBuffer(file.slice(startIndex, endIndex));
+                        reader.readAsArrayBuffer(fileRange.slice(chunkStartIndex, chunkEndIndex));
                     });
                 } catch (_ex) {
-                    return getError();
+                    // Rejected with the error event, the exception is in the reader
+                    readError = reader.error;
+                    return ReadStatus.Error;
+                }
+
+                if (metrics !== undefined) {
+                    metrics.readWaitMs += performance.now() - readStartTime;
                 }
 
                 if (isCancelled()) {
-                    return Result.error(null);
+                    return ReadStatus.Cancelled;
                 }
+
+                chunkStartIndex = chunkEndIndex;
             }
         }
+
+        return ReadStatus.Done;
     }
 
-    // All files read, calculate hash of the remaining bytes
-    if (readBufferIndex !== 0) {
-        dispatchSha1Worker(readAccumulatorBuffer.subarray(0, readBufferIndex));
+    let fileStartOffset = 0;
+    for (let fileIndex = 0; fileIndex < inputFiles.length; ++fileIndex) {
+        const { path, file } = inputFiles[fileIndex];
+        const fileOffset = fileStartOffset;
+        fileStartOffset += file.size;
+
+        // Position of the first byte to read from this file, which is not zero when continuing a previous run
+        const readStartIndex = Math.max(resumeByteOffset - fileOffset, 0);
+
+        if (file.size === 0 || readStartIndex >= file.size) {
+            // Files with 0 size don't contribute to the final hash, and completed files don't need to be read again
+            continue;
+        }
+
+        // The pieces inside the file with cached hashes don't need to be read
+        let skipStartIndex = file.size;
+        let skipEndIndex = file.size;
+        let skippedPieces: Uint8Array | null = null;
+
+        const cachedPieces = cachedFilePieces[fileIndex];
+        if (cachedPieces !== null) {
+            const { firstPieceIndex, pieceCount } = getFullPieceRange(fileOffset, file.size, blockSize);
+            const firstSkippedPieceIndex = Math.max(firstPieceIndex, resumePieceCount);
+            const endPieceIndex = firstPieceIndex + pieceCount;
+
+            if (firstSkippedPieceIndex < endPieceIndex) {
+                skipStartIndex = firstSkippedPieceIndex * blockSize - fileOffset;
+                skipEndIndex = endPieceIndex * blockSize - fileOffset;
+                skippedPieces = cachedPieces.subarray((firstSkippedPieceIndex - firstPieceIndex) * 20);
+            }
+        }
+
+        const filePath = path.join("/");
+        onReadingFileStarted(filePath);
+
+        readOffset = fileOffset + readStartIndex;
+        let readStatus = await readFileRange(file, readStartIndex, skipStartIndex);
+        if (readStatus === ReadStatus.Done && skippedPieces !== null) {
+            skipCachedPieces(skippedPieces);
+
+            readOffset = fileOffset + skipEndIndex;
+            readStatus = await readFileRange(file, skipEndIndex, file.size);
+        }
+
+        if (readStatus === ReadStatus.Error) {
+            checkpoint?.save();
+            const reason = readError instanceof Error ? `\n${readError.message}` : "";
+            return Result.error(
+                `Error reading file: \`${filePath}\`${reason}
+The file might be inaccessible, or might have been modified, moved, or deleted`,
+            );
+        }
+
+        if (readStatus === ReadStatus.Cancelled) {
+            return Result.error(null);
+        }
     }
 
+    // All files read, calculate hash of the remaining bytes
+    dispatchBatch();
+
     if (isCancelled()) {
         return Result.error(null);
     }
@@ -339,35 +834,46 @@ The file might be inaccessible, or might have been modified, moved, or deleted`,
         return Result.error(null);
     }
 
+    await checkpoint?.finish();
+    await pieceCache?.update(inputFiles, blockSize, piecesLocal);
+
+    for (const stream of subtreeStreams) {
+        stream.subtree.pieces = stream.pieces;
+    }
+
+    metrics?.finish();
+
     return Result.ok(piecesLocal);
 }
 
 export async function calculateInfoHash(infoObject: TorrentInfo) {
-    const bencodeBytes = new BencodeDict(infoObject).encode(new BencodeBuffer()).getBytes();
-
-    const workerPool = await workerPoolPromise;
-    const hashResult = await workerPool.computeHashes([bencodeBytes], null);
+    // Already calculated together with the pieces, if the info dictionary was not changed since then
+    const progressiveInfoHash = await getProgressiveInfoHash(infoObject);
+    if (progressiveInfoHash !== null) {
+        return progressiveInfoHash;
+    }
 
-    if (hashResult === null) {
-        // Shouldn't happen, this is not cancelable
-        throw Error("Calculation was cancelled");
+    const { files } = infoObject;
+    if (files !== undefined && files.length >= minParallelFileCount) {
+        return calculateInfoHashParallel({ ...infoObject, files });
     }
 
-    return [...hashResult.result].map(byte => byte.toString(16).padStart(2, "0")).join("");
+    return calculateEncodedHash(new BencodeDict(infoObject).encode(new BencodeBuffer()));
 }
 
-export function getAutoBlockSize(totalSize: number) {
+// Pieces larger than 16MB are only used if the worker pool can hash them (see canHashLargePieces in Sha1.ts)
+export function getAutoBlockSize(totalSize: number, canHashLargePieces = false) {
     const targetBlockCount = 1200;
     let factor = Math.round(Math.log2(totalSize / targetBlockCount));
     factor = Math.max(factor, 14); // 2^14 = 16 kb (minimum block size)
-    factor = Math.min(factor, 24); // 2^24 = 16 mb (maximum block size)
+    factor = Math.min(factor, canHashLargePieces ? 26 : 24); // 2^26 = 64 mb, 2^24 = 16 mb (maximum block size)
     return 1 << factor;
 }
 
-export function getBlockSize(blockSize: BlockSize, totalSize: number): number {
+export function getBlockSize(blockSize: BlockSize, totalSize: number, canHashLargePieces = false): number {
     switch (blockSize) {
         case BlockSize.Auto:
-            return getAutoBlockSize(totalSize);
+            return getAutoBlockSize(totalSize, canHashLargePieces);
         case BlockSize.KB16:
             return 16 * KB;
         case BlockSize.KB32:
@@ -390,5 +896,9 @@ export function getBlockSize(blockSize: BlockSize, totalSize: number): number {
             return 8 * MB;
         case BlockSize.MB16:
             return 16 * MB;
+        case BlockSize.MB32:
+            return 32 * MB;
+        case BlockSize.MB64:
+            return 64 * MB;
     }
 }
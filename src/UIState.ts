@@ -11,6 +11,8 @@ export const enum BlockSize {
     MB4,
     MB8,
     MB16,
+    MB32,
+    MB64,
 }
 
 export interface TorrentUIParameters {
@@ -22,4 +24,10 @@ export interface TorrentUIParameters {
     webSeeds: string;
     comment: string;
     source: string;
+    // Extra torrents with a different source, private flag or trackers, see parseTorrentVariants
+    variants: string;
+    // Also creates a torrent for each first-level subfolder, from the same hashing pass
+    createSubfolderTorrents: boolean;
+    // Reports the pieces which contain only zero bytes, which are checked while hashing
+    detectZeroPieces: boolean;
 }
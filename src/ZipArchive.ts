@@ -0,0 +1,589 @@
+/**
+Reads the list of members from a zip archive, without extracting it
+
+Deflated members are inflated while they are hashed: the compressed data is inflated with `DecompressionStream` on one
+of a few separate workers, and the inflated bytes are read through a byte stream, so the archive is never extracted to
+the disk
+The checksum of a member is checked when the whole member is read, on the same workers, so stored (uncompressed)
+members are also read through a worker then, which costs a copy and the checksum calculation; slices of stored members
+are read directly from the archive with {@link Blob.slice}, like the members of tar archives
+The files of the members only implement the parts of the `File` interface which are used for hashing (size, slice, and
+stream), see {@link HttpFile}
+Supports zip64 archives, and UTF-8 or code page 437 file names
+*/
+
+import type { FileWithRelativePath } from "./FileInput";
+import { ArchiveHeaderReader, normalizePath } from "./TarArchive";
+import { MB, Result } from "./Util";
+
+const endOfCentralDirectorySignature = 0x06054b50;
+const zip64LocatorSignature = 0x07064b50;
+const zip64EndOfCentralDirectorySignature = 0x06064b50;
+const centralDirectoryHeaderSignature = 0x02014b50;
+const localFileHeaderSignature = 0x04034b50;
+
+const endOfCentralDirectorySize = 22;
+const zip64LocatorSize = 20;
+const zip64EndOfCentralDirectorySize = 56;
+const centralDirectoryHeaderSize = 46;
+const localFileHeaderSize = 30;
+const maxCommentLength = 0xffff;
+
+const methodStored = 0;
+const methodDeflated = 8;
+
+const flagEncrypted = 0x1;
+const flagUtf8 = 0x800;
+
+const extraFieldZip64 = 0x0001;
+const extraFieldTimestamp = 0x5455;
+const extraFieldUnicodePath = 0x7075;
+
+// Inflated data is sent from the worker in chunks of at least this size, so there are fewer messages
+const inflateChunkSize = 1 * MB;
+
+// Members are read in parallel, e.g. when the files of the hashing run are read ahead
+const maxInflateWorkerCount = Math.min(navigator.hardwareConcurrency || 1, 4);
+
+// Characters 0x80-0xff of code page 437, which is used for file names without the UTF-8 flag
+const cp437HighCharacters =
+    "ÇüéâäàåçêëèïîìÄÅÉæÆôöòûùÿÖÜ¢£¥₧ƒáíóúñÑªº¿⌐¬½¼¡«»░▒▓│┤╡╢╖╕╣║╗╝╜╛┐└┴┬├─┼╞╟╚╔╩╦╠═╬╧╨╤╥╙╘╒╓╫╪┘┌█▄▌▐▀αßΓπΣσµτΦΘΩδ∞φε∩≡±≥≤⌠⌡÷≈°∙·√ⁿ²■\u00a0";
+
+const utf8Decoder = new TextDecoder();
+
+interface InflateRequest {
+    data: Blob;
+    // Stored members are only checked
+    isCompressed: boolean;
+    // Range of the inflated data to send
+    start: number;
+    end: number;
+    // Checked when the whole member is inflated
+    expectedCrc: number | null;
+    chunkSize: number;
+    port: MessagePort;
+}
+
+type InflateResponse = { chunk: Uint8Array<ArrayBuffer> | null } | { error: string };
+
+// Runs on the inflate worker
+// It's converted to a string, so it can't reference anything outside of the function
+function inflateWorkerMain() {
+    const crcTable = new Uint32Array(256);
+    for (let i = 0; i < 256; ++i) {
+        let crc = i;
+        for (let bit = 0; bit < 8; ++bit) {
+            crc = crc & 1 ? 0xedb88320 ^ (crc >>> 1) : crc >>> 1;
+        }
+        crcTable[i] = crc;
+    }
+
+    self.onmessage = (event: MessageEvent) => {
+        const { data, isCompressed, start, end, expectedCrc, chunkSize, port } = event.data as InflateRequest;
+        const source = data.stream();
+        const reader = (isCompressed ? source.pipeThrough(new DecompressionStream("deflate-raw")) : source).getReader();
+
+        // Position in the inflated data
+        let position = 0;
+        let crc = 0xffffffff;
+
+        const readChunk = async () => {
+            const parts: Uint8Array[] = [];
+            let length = 0;
+
+            while (length < chunkSize && position < end) {
+                const { value, done } = await reader.read();
+                if (done) {
+                    throw Error("The data of the member is truncated");
+                }
+
+                if (expectedCrc !== null) {
+                    for (let i = 0; i < value.length; ++i) {
+                        crc = crcTable[(crc ^ value[i]) & 0xff] ^ (crc >>> 8);
+                    }
+                }
+
+                const partStart = Math.max(start - position, 0);
+                const partEnd = Math.min(end - position, value.length);
+                position += value.length;
+
+                if (partStart < partEnd) {
+                    parts.push(value.subarray(partStart, partEnd));
+                    length += partEnd - partStart;
+                }
+            }
+
+            const isCrcMismatch = position !== end || (crc ^ 0xffffffff) >>> 0 !== expectedCrc;
+            if (expectedCrc !== null && position >= end && isCrcMismatch) {
+                throw Error("The data doesn't match the checksum, the archive might be damaged");
+            }
+
+            if (length === 0) {
+                return null;
+            }
+
+            const chunk = new Uint8Array(length);
+            let offset = 0;
+            for (const part of parts) {
+                chunk.set(part, offset);
+                offset += part.length;
+            }
+
+            return chunk;
+        };
+
+        port.onmessage = async ({ data: command }: MessageEvent<"pull" | "cancel">) => {
+            if (command === "cancel") {
+                reader.cancel().catch(() => {});
+                port.close();
+                return;
+            }
+
+            try {
+                const chunk = await readChunk();
+                port.postMessage({ chunk } satisfies InflateResponse, chunk === null ? [] : [chunk.buffer]);
+            } catch (ex) {
+                reader.cancel().catch(() => {});
+                port.postMessage({ error: ex instanceof Error ? ex.message : String(ex) } satisfies InflateResponse);
+            }
+        };
+    };
+}
+
+interface InflateWorker {
+    worker: Worker;
+    activeStreamCount: number;
+}
+
+// Created when they are needed, the least busy worker gets the next member
+// They are inline workers, because the single file build only supports the worker script of the hashing workers
+const inflateWorkers: InflateWorker[] = [];
+let inflateWorkerUrl: string | null = null;
+
+function acquireInflateWorker() {
+    let inflateWorker = inflateWorkers.reduce<InflateWorker | null>(
+        (best, current) => (best === null || current.activeStreamCount < best.activeStreamCount ? current : best),
+        null,
+    );
+
+    if (
+        inflateWorker === null ||
+        (inflateWorker.activeStreamCount !== 0 && inflateWorkers.length < maxInflateWorkerCount)
+    ) {
+        if (inflateWorkerUrl === null) {
+            const source = `(${inflateWorkerMain.toString()})();`;
+            inflateWorkerUrl = URL.createObjectURL(new Blob([source], { type: "text/javascript" }));
+        }
+
+        const worker = new Worker(inflateWorkerUrl, { name: `Zip inflate worker ${inflateWorkers.length + 1}` });
+        inflateWorker = { worker, activeStreamCount: 0 };
+        inflateWorkers.push(inflateWorker);
+    }
+
+    ++inflateWorker.activeStreamCount;
+    return inflateWorker;
+}
+
+function isInflateSupported() {
+    try {
+        new DecompressionStream("deflate-raw");
+        return true;
+    } catch {
+        return false;
+    }
+}
+
+class ZipMemberFile {
+    public readonly name: string;
+    public readonly lastModified: number;
+    public readonly webkitRelativePath = "";
+
+    private readonly compressedData: Blob;
+    private readonly isCompressed: boolean;
+    private readonly inflatedSize: number;
+    private readonly crc: number;
+    private readonly start: number;
+    private readonly end: number;
+
+    constructor(
+        compressedData: Blob,
+        isCompressed: boolean,
+        name: string,
+        lastModified: number,
+        inflatedSize: number,
+        crc: number,
+        start: number,
+        end: number,
+    ) {
+        this.compressedData = compressedData;
+        this.isCompressed = isCompressed;
+        this.name = name;
+        this.lastModified = lastModified;
+        this.inflatedSize = inflatedSize;
+        this.crc = crc;
+        this.start = start;
+        this.end = end;
+    }
+
+    public get size() {
+        return this.end - this.start;
+    }
+
+    // Same as Blob.slice, without negative indices
+    // A slice of a deflated member still inflates the member from its start, only the data before the slice is not sent
+    // from the worker
+    public slice(start = 0, end = this.size) {
+        start = Math.min(start, this.size);
+        end = Math.min(Math.max(end, start), this.size);
+
+        const { compressedData, isCompressed, name, lastModified, inflatedSize, crc } = this;
+        return new ZipMemberFile(
+            compressedData,
+            isCompressed,
+            name,
+            lastModified,
+            inflatedSize,
+            crc,
+            this.start + start,
+            this.start + end,
+        );
+    }
+
+    public stream() {
+        const isWholeMember = this.start === 0 && this.end === this.inflatedSize;
+        if (!this.isCompressed && !isWholeMember) {
+            // Nothing to check, the data is read directly
+            return this.compressedData.slice(this.start, this.end).stream();
+        }
+
+        const { port1, port2 } = new MessageChannel();
+        const inflateWorker = acquireInflateWorker();
+
+        let isReleased = false;
+        const release = () => {
+            port1.close();
+            if (!isReleased) {
+                isReleased = true;
+                --inflateWorker.activeStreamCount;
+            }
+        };
+
+        const request: InflateRequest = {
+            data: this.compressedData,
+            isCompressed: this.isCompressed,
+            start: this.start,
+            end: this.end,
+            expectedCrc: isWholeMember ? this.crc : null,
+            chunkSize: inflateChunkSize,
+            port: port2,
+        };
+        inflateWorker.worker.postMessage(request, [port2]);
+
+        const pullChunk = () =>
+            new Promise<InflateResponse>(resolve => {
+                port1.onmessage = (event: MessageEvent<InflateResponse>) => resolve(event.data);
+                port1.postMessage("pull");
+            });
+
+        return new ReadableStream({
+            type: "bytes",
+            pull: async controller => {
+                const response = await pullChunk();
+
+                if ("error" in response) {
+                    release();
+                    throw Error(response.error);
+                }
+
+                if (response.chunk === null) {
+                    release();
+                    controller.close();
+                    controller.byobRequest?.respond(0);
+                    return;
+                }
+
+                controller.enqueue(response.chunk);
+            },
+            cancel: () => {
+                port1.postMessage("cancel");
+                release();
+            },
+        });
+    }
+}
+
+// Reads the low and high 32 bits separately, sizes and offsets fit into a number
+function getUint64(view: DataView, offset: number) {
+    return view.getUint32(offset + 4, true) * 2 ** 32 + view.getUint32(offset, true);
+}
+
+function decodeCp437(bytes: Uint8Array) {
+    let result = "";
+    for (const byte of bytes) {
+        result += byte < 0x80 ? String.fromCharCode(byte) : cp437HighCharacters[byte - 0x80];
+    }
+
+    return result;
+}
+
+// Converts a date and time in MS-DOS format (local time, 2 second resolution) to a timestamp
+function getDosTimestamp(date: number, time: number) {
+    const year = (date >> 9) + 1980;
+    const month = ((date >> 5) & 0xf) - 1;
+    const day = date & 0x1f;
+    const hours = time >> 11;
+    const minutes = (time >> 5) & 0x3f;
+    const seconds = (time & 0x1f) * 2;
+
+    return new Date(year, month, day, hours, minutes, seconds).getTime();
+}
+
+function getArchiveBaseName(archiveName: string) {
+    const match = archiveName.match(/^(.+?)\.zip$/i);
+    return match === null ? archiveName : match[1];
+}
+
+interface CentralDirectoryLocation {
+    offset: number;
+    size: number;
+    entryCount: number;
+}
+
+async function readCentralDirectoryLocation(archive: Blob): Promise<Result<CentralDirectoryLocation, string>> {
+    // The end of central directory record is followed by a comment of up to 64 kB
+    const tailOffset = Math.max(archive.size - endOfCentralDirectorySize - maxCommentLength, 0);
+    const tail = new Uint8Array(await archive.slice(tailOffset).arrayBuffer());
+    const tailView = new DataView(tail.buffer);
+
+    let recordOffset = -1;
+    for (let i = tail.length - endOfCentralDirectorySize; i >= 0; --i) {
+        if (
+            tailView.getUint32(i, true) === endOfCentralDirectorySignature &&
+            i + endOfCentralDirectorySize + tailView.getUint16(i + 20, true) === tail.length
+        ) {
+            recordOffset = i;
+            break;
+        }
+    }
+
+    if (recordOffset === -1) {
+        return Result.error("This is not a zip archive, or it's damaged");
+    }
+
+    const diskNumber = tailView.getUint16(recordOffset + 4, true);
+    const centralDirectoryDisk = tailView.getUint16(recordOffset + 6, true);
+    let entryCount = tailView.getUint16(recordOffset + 10, true);
+    let size = tailView.getUint32(recordOffset + 12, true);
+    let offset = tailView.getUint32(recordOffset + 16, true);
+
+    // Values which don't fit are in the zip64 record, which is found through the locator before this record
+    const isZip64 = entryCount === 0xffff || size === 0xffffffff || offset === 0xffffffff;
+    if (isZip64) {
+        const locatorOffset = tailOffset + recordOffset - zip64LocatorSize;
+        if (locatorOffset < 0) {
+            return Result.error("The zip64 archive is damaged");
+        }
+
+        const locatorData = await archive.slice(locatorOffset, locatorOffset + zip64LocatorSize).arrayBuffer();
+        const locator = new DataView(locatorData);
+        if (locator.getUint32(0, true) !== zip64LocatorSignature) {
+            return Result.error("The zip64 archive is damaged");
+        }
+
+        if (locator.getUint32(16, true) > 1) {
+            return Result.error("Split zip archives are not supported");
+        }
+
+        const zip64RecordOffset = getUint64(locator, 8);
+        const zip64Record = new DataView(
+            await archive.slice(zip64RecordOffset, zip64RecordOffset + zip64EndOfCentralDirectorySize).arrayBuffer(),
+        );
+        if (
+            zip64Record.byteLength !== zip64EndOfCentralDirectorySize ||
+            zip64Record.getUint32(0, true) !== zip64EndOfCentralDirectorySignature
+        ) {
+            return Result.error("The zip64 archive is damaged");
+        }
+
+        entryCount = getUint64(zip64Record, 32);
+        size = getUint64(zip64Record, 40);
+        offset = getUint64(zip64Record, 48);
+    } else if (diskNumber !== 0 || centralDirectoryDisk !== 0) {
+        return Result.error("Split zip archives are not supported");
+    }
+
+    if (offset + size > archive.size) {
+        return Result.error("The zip archive is truncated");
+    }
+
+    return Result.ok({ offset, size, entryCount });
+}
+
+interface ZipMember {
+    path: string[];
+    method: number;
+    crc: number;
+    compressedSize: number;
+    size: number;
+    localHeaderOffset: number;
+    lastModified: number;
+}
+
+function readCentralDirectory(data: Uint8Array<ArrayBuffer>, entryCount: number): Result<ZipMember[], string> {
+    const view = new DataView(data.buffer, data.byteOffset, data.byteLength);
+    const members = new Map<string, ZipMember>();
+
+    let offset = 0;
+    for (let i = 0; i < entryCount; ++i) {
+        if (
+            offset + centralDirectoryHeaderSize > data.length ||
+            view.getUint32(offset, true) !== centralDirectoryHeaderSignature
+        ) {
+            return Result.error("Invalid zip central directory, the archive might be damaged");
+        }
+
+        const versionMadeBy = view.getUint16(offset + 4, true);
+        const flags = view.getUint16(offset + 8, true);
+        const method = view.getUint16(offset + 10, true);
+        const time = view.getUint16(offset + 12, true);
+        const date = view.getUint16(offset + 14, true);
+        const crc = view.getUint32(offset + 16, true);
+        let compressedSize = view.getUint32(offset + 20, true);
+        let size = view.getUint32(offset + 24, true);
+        const nameLength = view.getUint16(offset + 28, true);
+        const extraLength = view.getUint16(offset + 30, true);
+        const commentLength = view.getUint16(offset + 32, true);
+        const externalAttributes = view.getUint32(offset + 38, true);
+        let localHeaderOffset = view.getUint32(offset + 42, true);
+
+        const nameOffset = offset + centralDirectoryHeaderSize;
+        const extraOffset = nameOffset + nameLength;
+        offset = extraOffset + extraLength + commentLength;
+
+        if (offset > data.length) {
+            return Result.error("Invalid zip central directory, the archive might be damaged");
+        }
+
+        const nameBytes = data.subarray(nameOffset, extraOffset);
+        let pathText = flags & flagUtf8 ? utf8Decoder.decode(nameBytes) : decodeCp437(nameBytes);
+        let lastModified = getDosTimestamp(date, time);
+
+        for (let fieldOffset = extraOffset; fieldOffset + 4 <= extraOffset + extraLength; ) {
+            const fieldId = view.getUint16(fieldOffset, true);
+            const fieldSize = view.getUint16(fieldOffset + 2, true);
+            const fieldStart = fieldOffset + 4;
+            const fieldEnd = Math.min(fieldStart + fieldSize, extraOffset + extraLength);
+            fieldOffset = fieldStart + fieldSize;
+
+            if (fieldId === extraFieldZip64) {
+                // Only the values which don't fit into the header are present, in this order
+                let valueOffset = fieldStart;
+                const readValue = (value: number) => {
+                    if (value !== 0xffffffff || valueOffset + 8 > fieldEnd) {
+                        return value;
+                    }
+
+                    valueOffset += 8;
+                    return getUint64(view, valueOffset - 8);
+                };
+
+                size = readValue(size);
+                compressedSize = readValue(compressedSize);
+                localHeaderOffset = readValue(localHeaderOffset);
+            } else if (fieldId === extraFieldTimestamp && fieldEnd - fieldStart >= 5 && view.getUint8(fieldStart) & 1) {
+                lastModified = view.getInt32(fieldStart + 1, true) * 1000;
+            } else if (fieldId === extraFieldUnicodePath && !(flags & flagUtf8) && fieldEnd - fieldStart > 5) {
+                pathText = utf8Decoder.decode(data.subarray(fieldStart + 5, fieldEnd));
+            }
+        }
+
+        // Archives created on Windows might use backslashes
+        pathText = pathText.replaceAll("\\", "/");
+
+        const path = normalizePath(pathText);
+        if (path === null) {
+            return Result.error(`Unsupported path in the zip archive: \`${pathText}\``);
+        }
+
+        // Symbolic links are stored as files on Unix, with the target as their data
+        const isUnix = versionMadeBy >> 8 === 3;
+        const isSymbolicLink = isUnix && ((externalAttributes >>> 16) & 0xf000) === 0xa000;
+        if (path.length === 0 || pathText.endsWith("/") || isSymbolicLink) {
+            continue;
+        }
+
+        if (flags & flagEncrypted) {
+            return Result.error(`Encrypted zip archives are not supported: \`${pathText}\``);
+        }
+
+        if (method !== methodStored && method !== methodDeflated) {
+            return Result.error(`Unsupported compression method in the zip archive: \`${pathText}\``);
+        }
+
+        members.set(path.join("/"), { path, method, crc, compressedSize, size, localHeaderOffset, lastModified });
+    }
+
+    return Result.ok([...members.values()]);
+}
+
+export async function readZipEntries(archive: File): Promise<Result<FileWithRelativePath[], string>> {
+    const locationResult = (await readCentralDirectoryLocation(archive)).getData();
+    if (locationResult.isError) {
+        return Result.error(locationResult.error);
+    }
+
+    const { offset, size, entryCount } = locationResult.result;
+    const centralDirectory = new Uint8Array(await archive.slice(offset, offset + size).arrayBuffer());
+
+    const membersResult = readCentralDirectory(centralDirectory, entryCount).getData();
+    if (membersResult.isError) {
+        return Result.error(membersResult.error);
+    }
+
+    const members = membersResult.result;
+
+    if (members.some(member => member.method === methodDeflated && member.size !== 0) && !isInflateSupported()) {
+        return Result.error("Compressed zip archives are not supported in this browser");
+    }
+
+    // If every member is in the same folder, then that folder is the root when extracted
+    // Otherwise, the members are placed in a folder with the same name as the archive
+    const firstSegment = members.length === 0 ? null : members[0].path[0];
+    const hasCommonRoot = members.every(({ path }) => path.length > 1 && path[0] === firstSegment);
+    const rootPrefix = hasCommonRoot ? "" : getArchiveBaseName(archive.name) + "/";
+
+    // The local headers have variable sized fields, so the data offsets are only known after reading them
+    const reader = new ArchiveHeaderReader(archive);
+    const entries: FileWithRelativePath[] = [];
+
+    for (const { path, method, crc, compressedSize, size, localHeaderOffset, lastModified } of members) {
+        const header = await reader.read(localHeaderOffset, localFileHeaderSize);
+        const headerView = new DataView(header.buffer, header.byteOffset, header.byteLength);
+        if (header.length !== localFileHeaderSize || headerView.getUint32(0, true) !== localFileHeaderSignature) {
+            return Result.error(`Invalid zip header at offset ${localHeaderOffset}, the archive might be damaged`);
+        }
+
+        const nameLength = headerView.getUint16(26, true);
+        const extraLength = headerView.getUint16(28, true);
+        const dataOffset = localHeaderOffset + localFileHeaderSize + nameLength + extraLength;
+        if (dataOffset + compressedSize > archive.size) {
+            return Result.error("The zip archive is truncated");
+        }
+
+        const name = path[path.length - 1];
+        const compressedData = archive.slice(dataOffset, dataOffset + compressedSize);
+
+        let file: File;
+        if (size === 0) {
+            file = new File([], name, { lastModified });
+        } else {
+            const isCompressed = method === methodDeflated;
+            const memberFile = new ZipMemberFile(compressedData, isCompressed, name, lastModified, size, crc, 0, size);
+            file = memberFile as unknown as File;
+        }
+
+        entries.push({ relativePath: rootPrefix + path.join("/"), file });
+    }
+
+    return Result.ok(entries);
+}
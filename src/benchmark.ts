@@ -0,0 +1,33 @@
+import { runMetadataBenchmarks, type MetadataBenchmarkResult } from "./MetadataBenchmark";
+
+const resultsElement = document.getElementById("results")!;
+const downloadLink = document.getElementById("download") as HTMLAnchorElement;
+
+const columns: (keyof MetadataBenchmarkResult)[] = [
+    "fileCount",
+    "folderModelMs",
+    "assembleMs",
+    "bencodeModelMs",
+    "encodeMs",
+    "getBytesMs",
+    "fileListEncodeMs",
+    "infoHashMs",
+    "torrentBytes",
+    "maxHeapAfterStepBytes",
+];
+
+resultsElement.textContent = columns.join("\t") + "\n";
+
+const report = await runMetadataBenchmarks(result => {
+    const values = columns.map(column => {
+        const value = result[column];
+        return typeof value === "number" && !Number.isInteger(value) ? value.toFixed(1) : String(value);
+    });
+
+    resultsElement.textContent += values.join("\t") + "\n";
+});
+
+const reportJson = JSON.stringify(report, null, 4);
+
+downloadLink.href = URL.createObjectURL(new Blob([reportJson], { type: "application/json" }));
+downloadLink.style.display = "";
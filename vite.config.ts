@@ -177,6 +177,9 @@ const createSingleFilePlugin: PluginOption = {
 export default defineConfig(env => {
     const createSingleFile = env.mode === "singlefile";
 
+    // The library interface without the UI, see src/TorrentCreator.ts
+    const createLibrary = env.mode === "library";
+
     return {
         plugins: [svelte(), createSingleFile ? createSingleFilePlugin : null],
         base: "./",
@@ -184,7 +187,10 @@ export default defineConfig(env => {
             chunkSizeWarningLimit: 1024,
             assetsInlineLimit: () => true, // Inline everything
             sourcemap: !createSingleFile, // Disable source maps for single file builds - since it combines multiple files, source maps won't work
-            outDir: "./dist/",
+            outDir: createLibrary ? "./dist-library/" : "./dist/",
+            lib: createLibrary
+                ? { entry: "./src/TorrentCreator.ts", formats: ["es"], fileName: "torrent-creator" }
+                : undefined,
 
             // Create the least amount of files
             cssCodeSplit: false,